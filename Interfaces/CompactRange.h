@@ -0,0 +1,201 @@
+#ifndef COMPACTRANGE_H
+#define COMPACTRANGE_H
+
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "IVector.h"
+#include "ICompact.h"
+
+/* lazy range-for adapters over ICompact::iterator:
+ *
+ *     for (IVector const& point: CompactRange(compact->begin(step))) { ... }
+ *     for (IVector const& point: filter(CompactRange(compact->beginLatinHypercube(n, seed)), isFeasible)) { ... }
+ *     for (PointBatch const& batch: batches(filter(std::move(range), isFeasible), 256)) { ... }
+ *
+ * points are borrowed from the iterator (see ICompact::iterator::getCurrent) and valid until the next increment;
+ * nothing is allocated per point and no stage holds more than one batch of points */
+
+class CompactRange {
+public:
+    // takes ownership of <it>, nullptr gives an empty range
+    explicit CompactRange(ICompact::iterator *it):
+        it(it), rc(it != nullptr ? RESULT_CODE::SUCCESS : RESULT_CODE::BAD_REFERENCE) {}
+
+    CompactRange(CompactRange&& other): it(other.it), rc(other.rc) { other.it = nullptr; }
+
+    ~CompactRange() { delete it; }
+
+    class iterator {
+    public:
+        typedef IVector const& reference;
+
+        reference operator*() const { return *range->it->getCurrent(); }
+
+        iterator& operator++() {
+            range->rc = range->it->doStep();
+            if (range->rc != RESULT_CODE::SUCCESS) { range = nullptr; }
+            return *this;
+        }
+
+        bool operator==(iterator const& other) const { return range == other.range; }
+        bool operator!=(iterator const& other) const { return range != other.range; }
+
+    private:
+        friend class CompactRange;
+        // nullptr past the last point
+        CompactRange *range;
+
+        explicit iterator(CompactRange *range): range(range) {}
+    };
+
+    // single pass: begin() after a partial walk continues from the current point
+    iterator begin() { return iterator(rc == RESULT_CODE::SUCCESS ? this : nullptr); }
+    iterator end() { return iterator(nullptr); }
+
+    // OUT_OF_BOUNDS after a complete walk, the error of doStep or BAD_REFERENCE for a null iterator otherwise
+    RESULT_CODE status() const { return rc; }
+
+    // the underlying iterator, e.g. to save its state at the current point
+    ICompact::iterator* get() const { return it; }
+
+private:
+    ICompact::iterator *it;
+    RESULT_CODE rc;
+
+    CompactRange(CompactRange const& other) = delete;
+    CompactRange& operator=(CompactRange const& other) = delete;
+};
+
+// points of <Range> for which pred(point) is true; Range may be an lvalue reference to a range owned by the caller
+template<class Range, class Pred>
+class FilterRange {
+    typedef typename std::remove_reference<Range>::type::iterator Base;
+public:
+    FilterRange(Range&& range, Pred pred): range(std::forward<Range>(range)), pred(pred) {}
+
+    class iterator {
+    public:
+        typedef typename Base::reference reference;
+
+        reference operator*() const { return *pos; }
+
+        iterator& operator++() {
+            ++pos;
+            skip();
+            return *this;
+        }
+
+        bool operator==(iterator const& other) const { return pos == other.pos; }
+        bool operator!=(iterator const& other) const { return pos != other.pos; }
+
+    private:
+        friend class FilterRange;
+        Base pos, last;
+        Pred *pred;
+
+        iterator(Base pos, Base last, Pred *pred): pos(pos), last(last), pred(pred) { skip(); }
+
+        void skip() {
+            while (pos != last && !(*pred)(*pos)) { ++pos; }
+        }
+    };
+
+    iterator begin() { return iterator(range.begin(), range.end(), &pred); }
+    iterator end() { return iterator(range.end(), range.end(), &pred); }
+
+    RESULT_CODE status() const { return range.status(); }
+
+private:
+    Range range;
+    Pred pred;
+};
+
+template<class Range, class Pred>
+FilterRange<Range, Pred> filter(Range&& range, Pred pred) {
+    return FilterRange<Range, Pred>(std::forward<Range>(range), pred);
+}
+
+// up to <size> consecutive points copied into one buffer, point k is at coords + k * dim
+struct PointBatch {
+    double const *coords;
+    size_t count, dim;
+
+    double const* operator[](size_t k) const { return coords + k * dim; }
+};
+
+// groups the points of <Range> into batches, the buffer is allocated once and reused by every batch
+template<class Range>
+class BatchRange {
+    typedef typename std::remove_reference<Range>::type::iterator Base;
+public:
+    BatchRange(Range&& range, size_t size): range(std::forward<Range>(range)), size(size > 0 ? size : 1) {}
+
+    class iterator {
+    public:
+        typedef PointBatch const& reference;
+
+        reference operator*() const { return owner->batch; }
+
+        iterator& operator++() {
+            fill();
+            return *this;
+        }
+
+        bool operator==(iterator const& other) const { return owner == other.owner; }
+        bool operator!=(iterator const& other) const { return owner != other.owner; }
+
+    private:
+        friend class BatchRange;
+        // nullptr past the last batch
+        BatchRange *owner;
+        Base pos, last;
+
+        iterator(BatchRange *owner, Base pos, Base last): owner(owner), pos(pos), last(last) {
+            if (owner != nullptr) { fill(); }
+        }
+
+        void fill() {
+            auto& buffer = owner->buffer;
+            size_t count = 0, dim = 0;
+
+            for (; pos != last && count < owner->size; ++pos, ++count) {
+                IVector const& point = *pos;
+                dim = point.getDim();
+                if (buffer.size() < owner->size * dim) { buffer.resize(owner->size * dim); }
+
+                for (size_t i = 0; i < dim; i++) {
+                    buffer[count * dim + i] = point.getCoord(i);
+                }
+            }
+
+            if (count == 0) {
+                owner = nullptr;
+                return;
+            }
+            owner->batch.coords = buffer.data();
+            owner->batch.count = count;
+            owner->batch.dim = dim;
+        }
+    };
+
+    iterator begin() { return iterator(this, range.begin(), range.end()); }
+    iterator end() { return iterator(nullptr, range.end(), range.end()); }
+
+    RESULT_CODE status() const { return range.status(); }
+
+private:
+    Range range;
+    size_t size;
+    std::vector<double> buffer;
+    PointBatch batch;
+};
+
+template<class Range>
+BatchRange<Range> batches(Range&& range, size_t size) {
+    return BatchRange<Range>(std::forward<Range>(range), size);
+}
+
+#endif // COMPACTRANGE_H
@@ -25,6 +25,10 @@ public:
 
     static ICompact* makeConvex(ICompact const* const left, ICompact const* const right, ILogger*logger);
 
+    /* n-ary versions of intersection and makeConvex, computed in one pass over all bounds */
+    static ICompact* intersectionOf(ICompact const* const* compacts, size_t count, ILogger*logger);
+    static ICompact* convexHullOf(ICompact const* const* compacts, size_t count, ILogger*logger);
+
     /* returns a step, end, begin with which you can iterate over all domains of compact*/
     virtual IVector* getBegin() const = 0;
     virtual IVector* getEnd() const = 0;
@@ -32,6 +36,41 @@ public:
     virtual iterator* end(IVector const* const step = 0) = 0;
     virtual iterator* begin(IVector const* const step = 0) = 0;
 
+    /* seeded space-filling designs: <samples> points instead of a full grid, equal seeds give equal points */
+    virtual iterator* beginLatinHypercube(size_t samples, unsigned long long seed) = 0;
+    // one jittered point per stratum, m strata per axis where m^dim is the largest not exceeding <samples>
+    virtual iterator* beginStratified(size_t samples, unsigned long long seed) = 0;
+
+    /* adaptive iteration: the centres of the cells of a level are visited and scored, then the best
+       <keepRatio> part of the cells is halved along every axis longer than step, until no cell is longer than step;
+       a NaN score is the worst one */
+    typedef RESULT_CODE (*ScoreCallback)(IVector const* point, double& score, void* pContext); // lower is better
+    virtual iterator* beginAdaptive(IVector const* const step, ScoreCallback score, void* pContext, double keepRatio) = 0;
+
+    /* step grid points on the faceDim-dimensional faces only: 0 - vertices, 1 - edges, getDim() - 1 - the whole boundary;
+       a point shared by several faces is visited on one of them */
+    virtual size_t faceCount(size_t faceDim) const = 0;
+    virtual iterator* beginFaces(IVector const* const step, size_t faceDim) = 0;
+    // points of face number <face> < faceCount(faceDim) only, faces never share points and may be walked in parallel;
+    // nullptr when all points of the face belong to other faces
+    virtual iterator* beginFace(IVector const* const step, size_t faceDim, size_t face) = 0;
+
+    // number of points begin(step) and end(-step) visit, per axis (optional, getDim() items) and in total,
+    // OUT_OF_BOUNDS when the total does not fit into size_t (per axis counts are still filled)
+    virtual RESULT_CODE gridSize(IVector const* const step, size_t* perAxis, size_t& total) const = 0;
+    // time to evaluate every grid point given the measured time of one evaluation
+    virtual RESULT_CODE estimateCost(IVector const* const step, double secondsPerPoint, double& seconds) const = 0;
+
+    /* writes the grid of begin(step) to a binary file for external evaluators:
+       header {uint32 magic "CGRD", uint32 version, uint64 dim, uint64 points, uint64 dataOffset},
+       begin, end and step as dim doubles each, points per axis as dim uint64,
+       then from the page aligned dataOffset one column of <points> doubles per axis, points in the order of begin(step);
+       the points are written in <partitions> slices, in parallel up to the number of cores */
+    virtual RESULT_CODE exportGrid(IVector const* const step, char const* path, size_t partitions) const = 0;
+
+    // recreates an iterator over this compact from a blob written by iterator::saveState
+    virtual iterator* restore(void const* pState, size_t size) = 0;
+
     virtual RESULT_CODE isContains(IVector const* const vec, bool& result) const = 0;
     virtual RESULT_CODE isSubSet(ICompact const* const other,bool& result) const = 0;
     virtual RESULT_CODE isIntersects(ICompact const* const other, bool& result) const = 0;
@@ -50,10 +89,16 @@ public:
         virtual RESULT_CODE doStep() = 0;
 
         virtual IVector* getPoint() const = 0;
+        // the same point without a copy, owned by the iterator and valid until its next doStep or setDirection
+        virtual IVector const* getCurrent() const = 0;
 
         //change order of step
         virtual RESULT_CODE setDirection(IVector const* const dir) = 0;
 
+        //traversal state as a small blob, see ICompact::restore
+        virtual size_t getStateSize() const = 0;
+        virtual RESULT_CODE saveState(void* pBuffer, size_t size) const = 0;
+
         /*dtor*/
         virtual ~iterator() = default;
     protected:
@@ -2,11 +2,30 @@
 #define ISET_H
 #include "ILogger.h"
 #include "IVector.h"
+
+#include <type_traits>
+
+class ICompact;
+
 class ISet {
 public:
 	static ISet* createSet(ILogger* pLogger);
+	// for lookups with a fixed norm and tolerance: elements are hashed by grid cells twice as wide as <tolerance>,
+	// so such a lookup checks at most 2^dim cells; lookups with other tolerances stay correct but may check more.
+	// A Bloom filter of the occupied cells answers most lookups near no element without reading the cells
+	static ISet* createSet(ILogger* pLogger, IVector::NORM norm, double tolerance);
+	// the same grid split into shards with a lock each: threads may insert and look up by sample at once,
+	// elements stay distinct within <tolerance> across shards; the other methods lock the shards they read or the whole set
+	static ISet* createConcurrentSet(ILogger* pLogger, IVector::NORM norm, double tolerance);
+	// the set written by save, mapped: nothing is read or deduplicated up front, pages are read on first access
+	// and copied before they change; the file should not change while the set or its clones use it.
+	// A concurrent set comes back as the hashed set of the same tolerance
+	static ISet* open(char const* path, ILogger* pLogger);
 	virtual~ISet() = 0;
 	virtual RESULT_CODE insert(const IVector* pVector,IVector::NORM norm, double tolerance) = 0;
+	// inserts pVectors[0 .. count) as <count> inserts in this order would, without logging every rejected point;
+	// status[k] (if status is not null) gets what insert would return for pVectors[k]
+	virtual RESULT_CODE insertBulk(IVector const* const* pVectors, size_t count, IVector::NORM norm, double tolerance, RESULT_CODE* status) = 0;
 	virtual RESULT_CODE get(IVector*& pVector, size_t index)const = 0;
 	virtual RESULT_CODE get(IVector*& pVector, IVector const* pSample, IVector::NORM norm, double tolerance)const = 0;
 	virtual size_t getDim() const = 0; //space dimension
@@ -14,13 +33,79 @@ public:
 	virtual void clear() = 0; // delete all
 	virtual RESULT_CODE erase(size_t index) = 0;
 	virtual RESULT_CODE erase(IVector const* pSample, IVector::NORM norm, double tolerance) = 0;
+	// the last element takes the place of the erased one instead of the later ones moving down:
+	// O(1) expected for the hashed and concurrent sets, O(log^2 n) for the default one
+	virtual RESULT_CODE swapErase(size_t index) = 0;
+	virtual RESULT_CODE swapErase(IVector const* pSample, IVector::NORM norm, double tolerance) = 0;
+	// shares the elements with this set until either changes, a change copies only the pages it touches;
+	// the clone may be read by another thread while this set changes
 	virtual ISet* clone()const = 0;
+	// the elements and the spatial index in the layout open maps as they are
+	virtual RESULT_CODE save(char const* path) const = 0;
+
+	// borrowed read-only access to the elements: no copies, the coordinates stay valid until the set is changed
+	class Visitor {
+	public:
+		// element <index> has getDim() coordinates at <coords>; false stops the walk
+		virtual bool visit(size_t index, double const* coords) = 0;
+		virtual ~Visitor() = default;
+	};
+	// visits the elements in index order
+	virtual RESULT_CODE forEach(Visitor& visitor) const = 0;
+	template<class Func, class = typename std::enable_if<!std::is_base_of<Visitor, Func>::value>::type>
+	RESULT_CODE forEach(Func func) const {
+		FuncVisitor<Func> visitor(func);
+		return forEach(static_cast<Visitor&>(visitor));
+	}
+	// elements [first, first + count) lie one after another at coords, count is returned and 0 past the end:
+	//     for (size_t first = 0, count; (count = set->getSpan(first, coords)) != 0; first += count) { ... }
+	// a span of a concurrent set is a copy owned by the calling thread, valid until its next getSpan of a concurrent set
+	virtual size_t getSpan(size_t first, double const*& coords) const = 0;
+
+	// indices of the <k> elements closest to pSample, closest first and equally close ones by index,
+	// into indices[0 .. count), count = min(k, getSize())
+	virtual RESULT_CODE knn(IVector const* pSample, IVector::NORM norm, size_t k, size_t* indices, size_t& count) const = 0;
+	// visits the elements no farther than <radius> from pSample in index order
+	virtual RESULT_CODE radiusQuery(IVector const* pSample, IVector::NORM norm, double radius, Visitor& visitor) const = 0;
+	template<class Func, class = typename std::enable_if<!std::is_base_of<Visitor, Func>::value>::type>
+	RESULT_CODE radiusQuery(IVector const* pSample, IVector::NORM norm, double radius, Func func) const {
+		FuncVisitor<Func> visitor(func);
+		return radiusQuery(pSample, norm, radius, static_cast<Visitor&>(visitor));
+	}
+
+	// elements inside the box [pBox->getBegin(), pBox->getEnd()], boundary included: counted, visited in index order or erased
+	virtual RESULT_CODE countInBox(ICompact const* pBox, size_t& count) const = 0;
+	virtual RESULT_CODE queryBox(ICompact const* pBox, Visitor& visitor) const = 0;
+	template<class Func, class = typename std::enable_if<!std::is_base_of<Visitor, Func>::value>::type>
+	RESULT_CODE queryBox(ICompact const* pBox, Func func) const {
+		FuncVisitor<Func> visitor(func);
+		return queryBox(pBox, static_cast<Visitor&>(visitor));
+	}
+	// the rest keep their order
+	virtual RESULT_CODE eraseInBox(ICompact const* pBox, size_t& erased) = 0;
+	// erases in one pass the elements for which predicate.visit(index, coords), called in index order, is true;
+	// the rest keep their order
+	virtual RESULT_CODE eraseIf(Visitor& predicate, size_t& erased) = 0;
+	template<class Func, class = typename std::enable_if<!std::is_base_of<Visitor, Func>::value>::type>
+	RESULT_CODE eraseIf(Func func, size_t& erased) {
+		FuncVisitor<Func> predicate(func);
+		return eraseIf(static_cast<Visitor&>(predicate), erased);
+	}
 	static ISet* add(ISet const* pOperand1, ISet const* pOperand2, IVector::NORM norm, double tolerance, ILogger* pLogger);
 	static ISet* intersect(ISet const* pOperand1, ISet const* pOperand2, IVector::NORM norm, double tolerance, ILogger* pLogger);
         static ISet* sub(ISet const* pOperand1, ISet const* pOperand2, IVector::NORM norm, double tolerance, ILogger* pLogger);
 	static ISet* symSub(ISet const* pOperand1, ISet const* pOperand2, IVector::NORM norm, double tolerance, ILogger* pLogger);
 protected:
 	ISet() = default;
+
+	template<class Func>
+	class FuncVisitor: public Visitor {
+	public:
+		explicit FuncVisitor(Func& func): func(func) {}
+		bool visit(size_t index, double const* coords) override { return func(index, coords); }
+	private:
+		Func& func;
+	};
 private:
 	ISet(ISet const& set) = delete;
 	ISet& operator=(ISet const& vector) = delete;
@@ -19,9 +19,13 @@ public:
     virtual RESULT_CODE setProblem(IProblem *pProblem) = 0;
     virtual RESULT_CODE setProblemParams(IVector const* params) = 0;
     virtual RESULT_CODE setCompact(ICompact * pCompact) = 0;
+    // solve() saves its progress to <path> every <period> points and resumes from it on restart
+    virtual RESULT_CODE setCheckpoint(char const* path, size_t period) = 0;
 
     virtual size_t getParamsDim() const = 0;
 
+    // grid size for the current compact and step and its cost from a few timed evaluations of the problem
+    virtual RESULT_CODE estimateCost(size_t& points, double& seconds) = 0;
     virtual RESULT_CODE solve() = 0;
     virtual RESULT_CODE getSolution(IVector * &vec)const = 0;
 
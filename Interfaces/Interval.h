@@ -0,0 +1,53 @@
+#ifndef INTERVAL_H
+#define INTERVAL_H
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+/* closed interval [lo, hi]; every operation rounds its bounds outwards,
+ * so the result encloses all values of the operation over its operands */
+class Interval {
+public:
+    double lo, hi;
+
+    Interval(double value = 0): lo(value), hi(value) {}
+    Interval(double lo, double hi): lo(lo), hi(hi) {}
+
+    double width() const { return hi - lo; }
+    bool contains(double value) const { return lo <= value && value <= hi; }
+
+    friend Interval operator+(Interval const& l, Interval const& r) {
+        return outward(l.lo + r.lo, l.hi + r.hi);
+    }
+
+    friend Interval operator-(Interval const& l, Interval const& r) {
+        return outward(l.lo - r.hi, l.hi - r.lo);
+    }
+
+    friend Interval operator-(Interval const& v) {
+        return Interval(-v.hi, -v.lo);
+    }
+
+    friend Interval operator*(Interval const& l, Interval const& r) {
+        double
+                a = l.lo * r.lo, b = l.lo * r.hi,
+                c = l.hi * r.lo, d = l.hi * r.hi;
+        return outward(std::min(std::min(a, b), std::min(c, d)), std::max(std::max(a, b), std::max(c, d)));
+    }
+
+    // tighter than v * v: the square of an interval around zero starts at zero
+    friend Interval sqr(Interval const& v) {
+        if (v.lo >= 0) { return outward(v.lo * v.lo, v.hi * v.hi); }
+        if (v.hi <= 0) { return outward(v.hi * v.hi, v.lo * v.lo); }
+        return Interval(0, std::nextafter(std::max(v.lo * v.lo, v.hi * v.hi), std::numeric_limits<double>::infinity()));
+    }
+
+private:
+    static Interval outward(double lo, double hi) {
+        return Interval(std::nextafter(lo, -std::numeric_limits<double>::infinity()),
+                        std::nextafter(hi, std::numeric_limits<double>::infinity()));
+    }
+};
+
+#endif // INTERVAL_H
@@ -2,7 +2,7 @@ CONFIG -= qt
 
 TEMPLATE = lib
 
-CONFIG += c++11
+CONFIG += c++11 thread
 
 # You can make your code fail to compile if it uses deprecated APIs.
 # In order to do so, uncomment the following line.
@@ -16,7 +16,8 @@ HEADERS += \
     include/RC.h \
     include/ILogger.h \
     include/IVector.h \
-    include/ICompact.h
+    include/ICompact.h \
+    include/ParallelFor.h
 
 LIBS += \
     -L$$PWD/libs/ -llogger \
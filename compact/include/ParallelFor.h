@@ -0,0 +1,42 @@
+#ifndef PARALLELFOR_H
+#define PARALLELFOR_H
+
+#include <algorithm>
+#include <cstddef>
+#include <new>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+/* splits [0, count) into contiguous ranges of at least <grain> items and runs func(from, to) on each,
+ * one range on the calling thread and the others on threads of their own:
+ *
+ *     parallelFor(points, 1024, [&](size_t from, size_t to) { ... });
+ *
+ * nothing escapes it: the ranges whose thread cannot be started or stored run on the calling thread after its own */
+template<class Func>
+void parallelFor(size_t count, size_t grain, Func func) {
+    size_t workers = std::thread::hardware_concurrency();
+    if (grain == 0) { grain = 1; }
+    workers = std::min(workers, count / grain);
+
+    if (workers <= 1) {
+        func(static_cast<size_t>(0), count);
+        return;
+    }
+
+    std::vector<std::thread> threads;
+    size_t chunk = (count + workers - 1) / workers, started = chunk;
+    try {
+        threads.reserve(workers - 1);
+        for (; started < count; started += chunk) { threads.emplace_back(func, started, std::min(count, started + chunk)); }
+    } catch (std::system_error const&) {
+    } catch (std::bad_alloc const&) {
+    }
+
+    func(static_cast<size_t>(0), chunk);
+    for (size_t from = started; from < count; from += chunk) { func(from, std::min(count, from + chunk)); }
+    for (auto &t: threads) { t.join(); }
+}
+
+#endif // PARALLELFOR_H
@@ -1,10 +1,16 @@
 #include <new>
 #include <cmath>
 #include <cstdlib>
+#include <cstring>
 #include <algorithm>
+#include <vector>
+#include <limits>
+#include <memory>
+#include <fstream>
 
 #include "include/IVector.h"
 #include "include/ICompact.h"
+#include "include/ParallelFor.h"
 
 namespace {
     static bool isLess(IVector const* l, IVector const* r) {
@@ -35,17 +41,624 @@ namespace {
         return true;
     }
 
-    class CompactImpl: public ICompact {
+    // counter based generator: the same (seed, counter) pair always gives the same value,
+    // so points may be generated by any thread in any order
+    static unsigned long long splitMix(unsigned long long x) {
+        x += 0x9E3779B97F4A7C15ULL;
+        x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+        return x ^ (x >> 31);
+    }
+
+    // uniform in [0, 1)
+    static double uniform(unsigned long long seed, unsigned long long counter) {
+        return static_cast<double>(splitMix(seed ^ splitMix(counter)) >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+    // coordinate of grid point k of <count> on an axis: left + k * step, the last one is right itself
+    static double gridCoord(double lo, double hi, double step, size_t k, size_t count) {
+        return k == 0 ? lo : (k + 1 == count ? hi : lo + k * step);
+    }
+
+    // header of the file written by ICompact::exportGrid, see ICompact.h for the layout
+    struct GridFileHeader {
+        static const unsigned int signature = 0x44524743; // "CGRD"
+        static const unsigned int currentVersion = 1;
+        static const size_t alignment = 4096;
+
+        unsigned int magic;
+        unsigned int version;
+        unsigned long long dim;
+        unsigned long long points;
+        unsigned long long dataOffset;
+    };
+
+    // header of the blob written by iterator::saveState, followed by
+    // current, dir and step coordinates for grid iterators
+    struct IteratorState {
+        enum Kind : unsigned int {
+            GRID = 1,
+            SAMPLE = 2
+        };
+        static const unsigned int signature = 0x52544943; // "CITR"
+
+        unsigned int magic;
+        unsigned int kind;
+        unsigned long long dim;
+        unsigned int reverse;
+        unsigned int design;
+        unsigned long long samples;
+        unsigned long long seed;
+        unsigned long long index;
+    };
+
+    class SampleIterator : public ICompact::iterator {
+    public:
+        enum class Design {
+            LATIN_HYPERCUBE,
+            STRATIFIED
+        };
+
+        static SampleIterator* create(IVector const* left, IVector const* right, size_t samples,
+                                      unsigned long long seed, Design design, ILogger *logger) {
+            auto dim = left->getDim();
+
+            if (design == Design::STRATIFIED) {
+                samples = stratifiedCount(samples, dim);
+            }
+
+            if (samples == 0) {
+                if (logger != nullptr) {
+                    logger->log("in SampleIterator::create: zero samples", RESULT_CODE::WRONG_ARGUMENT);
+                }
+                return nullptr;
+            }
+
+            if (samples > std::numeric_limits<size_t>::max() / dim / sizeof(double)) {
+                if (logger != nullptr) {
+                    logger->log("in SampleIterator::create: too many samples", RESULT_CODE::WRONG_ARGUMENT);
+                }
+                return nullptr;
+            }
+
+            auto points = new (std::nothrow) double[samples * dim];
+            auto current = left->clone();
+            auto it = new (std::nothrow) SampleIterator(points, samples, dim, current, design, seed, logger);
+
+            if (points == nullptr || current == nullptr || it == nullptr) {
+                if (logger != nullptr) {
+                    logger->log("in SampleIterator::create: no memory", RESULT_CODE::OUT_OF_MEMORY);
+                }
+                if (it != nullptr) {
+                    delete it;
+                } else {
+                    delete[] points;
+                    delete current;
+                }
+                return nullptr;
+            }
+
+            design == Design::LATIN_HYPERCUBE ? it->fillLatinHypercube(left, right, seed)
+                                              : it->fillStratified(left, right, seed);
+            it->moveTo(0);
+            return it;
+        }
+
+        // points are regenerated from the seed, only the position is restored
+        static SampleIterator* restore(IVector const* left, IVector const* right, IteratorState const& state, ILogger *logger) {
+            if (state.design > static_cast<unsigned int>(Design::STRATIFIED)) {
+                if (logger != nullptr) {
+                    logger->log("in SampleIterator::restore: unknown design", RESULT_CODE::WRONG_ARGUMENT);
+                }
+                return nullptr;
+            }
+
+            auto it = create(left, right, state.samples, state.seed, static_cast<Design>(state.design), logger);
+            if (it == nullptr) { return nullptr; }
+
+            if (it->samples != state.samples || state.index >= it->samples) {
+                if (logger != nullptr) {
+                    logger->log("in SampleIterator::restore: position out of design", RESULT_CODE::OUT_OF_BOUNDS);
+                }
+                delete it;
+                return nullptr;
+            }
+
+            it->moveTo(state.index);
+            return it;
+        }
+
+        RESULT_CODE doStep() override {
+            if (index + 1 >= samples) { return RESULT_CODE::OUT_OF_BOUNDS; }
+            moveTo(index + 1);
+            return RESULT_CODE::SUCCESS;
+        }
+
+        IVector* getPoint() const override { return current->clone(); }
+
+        IVector const* getCurrent() const override { return current; }
+
+        RESULT_CODE setDirection(IVector const* const) override {
+            if (logger != nullptr) {
+                logger->log("in SampleIterator::setDirection: sampling designs have no direction", RESULT_CODE::WRONG_ARGUMENT);
+            }
+            return RESULT_CODE::WRONG_ARGUMENT;
+        }
+
+        size_t getStateSize() const override { return sizeof(IteratorState); }
+
+        RESULT_CODE saveState(void* pBuffer, size_t size) const override {
+            if (pBuffer == nullptr || size < getStateSize()) {
+                if (logger != nullptr) {
+                    logger->log("in SampleIterator::saveState: buffer is too small", RESULT_CODE::BAD_REFERENCE);
+                }
+                return RESULT_CODE::BAD_REFERENCE;
+            }
+
+            IteratorState state = {};
+            state.magic = IteratorState::signature;
+            state.kind = IteratorState::SAMPLE;
+            state.dim = dim;
+            state.design = static_cast<unsigned int>(design);
+            state.samples = samples;
+            state.seed = seed;
+            state.index = index;
+
+            memcpy(pBuffer, &state, sizeof(state));
+            return RESULT_CODE::SUCCESS;
+        }
+
+        ~SampleIterator() override {
+            delete[] points;
+            delete current;
+        }
+
     private:
-        // begin - left, end - right
+        // coordinates of point k are points[k * dim .. k * dim + dim)
+        double *points;
+        size_t samples, dim, index;
+        IVector *current;
+        Design design;
+        unsigned long long seed;
+        ILogger *logger;
+
+        SampleIterator(double *points, size_t samples, size_t dim, IVector *current,
+                       Design design, unsigned long long seed, ILogger *logger):
+            points(points), samples(samples), dim(dim), index(0), current(current),
+            design(design), seed(seed), logger(logger) {}
+
+        SampleIterator(const SampleIterator& other) = delete;
+        void operator=(const SampleIterator& other) = delete;
+
+        static size_t stratifiedCount(size_t samples, size_t dim) {
+            size_t perAxis = static_cast<size_t>(std::floor(std::pow(static_cast<double>(samples), 1.0 / dim)));
+            // pow rounding may be off by one in both directions
+            while (perAxis > 0 && std::pow(static_cast<double>(perAxis), static_cast<double>(dim)) > samples) {
+                perAxis--;
+            }
+            while (std::pow(static_cast<double>(perAxis + 1), static_cast<double>(dim)) <= samples) {
+                perAxis++;
+            }
+            return static_cast<size_t>(std::pow(static_cast<double>(perAxis), static_cast<double>(dim)) + 0.5);
+        }
+
+        void moveTo(size_t k) {
+            index = k;
+            for (size_t i = 0; i < dim; i++) {
+                current->setCoord(i, points[k * dim + i]);
+            }
+        }
+
+        // every axis is split into <samples> strata, each stratum of each axis is hit exactly once;
+        // the strata are shuffled in the column of the axis itself, so the threads allocate nothing
+        void fillLatinHypercube(IVector const* left, IVector const* right, unsigned long long seed) {
+            parallelFor(dim, 1, [&](size_t from, size_t to) {
+                for (size_t i = from; i < to; i++) {
+                    auto axisSeed = splitMix(seed + i);
+                    double lo = left->getCoord(i), width = right->getCoord(i) - lo;
+                    double *column = points + i;
+
+                    for (size_t k = 0; k < samples; k++) { column[k * dim] = static_cast<double>(k); }
+                    for (size_t k = samples - 1; k > 0; k--) {
+                        std::swap(column[k * dim], column[splitMix(axisSeed ^ splitMix(k)) % (k + 1) * dim]);
+                    }
+
+                    for (size_t k = 0; k < samples; k++) {
+                        double u = uniform(axisSeed, samples + k);
+                        column[k * dim] = lo + (column[k * dim] + u) / samples * width;
+                    }
+                }
+            });
+        }
+
+        void fillStratified(IVector const* left, IVector const* right, unsigned long long seed) {
+            auto perAxis = static_cast<size_t>(std::pow(static_cast<double>(samples), 1.0 / dim) + 0.5);
+
+            parallelFor(samples, 4096, [&](size_t from, size_t to) {
+                for (size_t k = from; k < to; k++) {
+                    size_t cell = k;
+                    for (size_t i = 0; i < dim; i++) {
+                        double lo = left->getCoord(i), width = right->getCoord(i) - lo;
+                        double u = uniform(seed, k * dim + i);
+
+                        points[k * dim + i] = lo + (cell % perAxis + u) / perAxis * width;
+                        cell /= perAxis;
+                    }
+                }
+            });
+        }
+    };
+
+    class AdaptiveIterator : public ICompact::iterator {
+    public:
+        static AdaptiveIterator* create(IVector const* left, IVector const* right, IVector const* step,
+                                        ICompact::ScoreCallback score, void* pContext, double keepRatio, ILogger *logger) {
+            if (score == nullptr || step == nullptr || step->getDim() != left->getDim()) {
+                if (logger != nullptr) {
+                    logger->log("in AdaptiveIterator::create: null callback or step of wrong dimension", RESULT_CODE::BAD_REFERENCE);
+                }
+                return nullptr;
+            }
+
+            if (std::isnan(keepRatio) || keepRatio <= 0 || keepRatio > 1) {
+                if (logger != nullptr) {
+                    logger->log("in AdaptiveIterator::create: keep ratio should be in (0, 1]", RESULT_CODE::WRONG_ARGUMENT);
+                }
+                return nullptr;
+            }
+
+            auto dim = left->getDim();
+            for (size_t i = 0; i < dim; i++) {
+                if (std::isnan(step->getCoord(i)) || step->getCoord(i) <= 0) {
+                    if (logger != nullptr) {
+                        logger->log("in AdaptiveIterator::create: incorrect step", RESULT_CODE::WRONG_ARGUMENT);
+                    }
+                    return nullptr;
+                }
+            }
+
+            auto current = left->clone();
+            auto it = new (std::nothrow) AdaptiveIterator(dim, current, score, pContext, keepRatio, logger);
+            if (current == nullptr || it == nullptr) {
+                if (logger != nullptr) {
+                    logger->log("in AdaptiveIterator::create: no memory", RESULT_CODE::OUT_OF_MEMORY);
+                }
+                it != nullptr ? delete it : delete current;
+                return nullptr;
+            }
+
+            it->step.resize(dim);
+            it->lows.resize(dim);
+            it->highs.resize(dim);
+            for (size_t i = 0; i < dim; i++) {
+                it->step[i] = step->getCoord(i);
+                it->lows[i] = left->getCoord(i);
+                it->highs[i] = right->getCoord(i);
+            }
+            it->scores.resize(1);
+            it->moveTo(0);
+            return it;
+        }
+
+        // scores the current cell, then moves to the next one of the level or refines the level
+        RESULT_CODE doStep() override {
+            auto rc = score(current, scores[index], pContext);
+            if (rc != RESULT_CODE::SUCCESS) {
+                if (logger != nullptr) {
+                    logger->log("in AdaptiveIterator::doStep: score callback failed", rc);
+                }
+                return rc;
+            }
+            // a NaN, e.g. of a goal outside its domain, would break the ordering of the cells: it is the worst score
+            if (std::isnan(scores[index])) { scores[index] = std::numeric_limits<double>::infinity(); }
+
+            if (index + 1 < scores.size()) {
+                moveTo(index + 1);
+                return RESULT_CODE::SUCCESS;
+            }
+
+            if (!refine()) { return RESULT_CODE::OUT_OF_BOUNDS; }
+            moveTo(0);
+            return RESULT_CODE::SUCCESS;
+        }
+
+        IVector* getPoint() const override { return current->clone(); }
+
+        IVector const* getCurrent() const override { return current; }
+
+        RESULT_CODE setDirection(IVector const* const) override {
+            if (logger != nullptr) {
+                logger->log("in AdaptiveIterator::setDirection: adaptive iteration has no direction", RESULT_CODE::WRONG_ARGUMENT);
+            }
+            return RESULT_CODE::WRONG_ARGUMENT;
+        }
+
+        // the score callback cannot be stored, so there is nothing to restore from
+        size_t getStateSize() const override { return 0; }
+
+        RESULT_CODE saveState(void*, size_t) const override {
+            if (logger != nullptr) {
+                logger->log("in AdaptiveIterator::saveState: adaptive iteration cannot be saved", RESULT_CODE::WRONG_ARGUMENT);
+            }
+            return RESULT_CODE::WRONG_ARGUMENT;
+        }
+
+        ~AdaptiveIterator() override { delete current; }
+
+    private:
+        size_t dim, index;
+        // cells of the current level: bounds of cell k are lows/highs[k * dim .. k * dim + dim)
+        std::vector<double> lows, highs, scores, step;
+        IVector *current;
+        ICompact::ScoreCallback score;
+        void *pContext;
+        double keepRatio;
+        ILogger *logger;
+
+        AdaptiveIterator(size_t dim, IVector *current, ICompact::ScoreCallback score,
+                         void *pContext, double keepRatio, ILogger *logger):
+            dim(dim), index(0), current(current), score(score),
+            pContext(pContext), keepRatio(keepRatio), logger(logger) {}
+
+        AdaptiveIterator(const AdaptiveIterator& other) = delete;
+        void operator=(const AdaptiveIterator& other) = delete;
+
+        void moveTo(size_t k) {
+            index = k;
+            for (size_t i = 0; i < dim; i++) {
+                current->setCoord(i, (lows[k * dim + i] + highs[k * dim + i]) / 2);
+            }
+        }
+
+        // replaces the level by the children of its best cells, false when none of them can be split
+        bool refine() {
+            size_t cells = scores.size();
+            size_t keep = std::max<size_t>(1, static_cast<size_t>(std::ceil(keepRatio * cells)));
+
+            std::vector<size_t> order(cells);
+            for (size_t k = 0; k < cells; k++) { order[k] = k; }
+            std::nth_element(order.begin(), order.begin() + (keep - 1), order.end(),
+                             [this](size_t l, size_t r) { return scores[l] < scores[r]; });
+
+            std::vector<double> childLows, childHighs;
+            std::vector<size_t> split;
+            for (size_t n = 0; n < keep; n++) {
+                size_t k = order[n];
+                double const *lo = &lows[k * dim], *hi = &highs[k * dim];
+
+                split.clear();
+                for (size_t i = 0; i < dim; i++) {
+                    if (hi[i] - lo[i] > step[i]) { split.push_back(i); }
+                }
+                if (split.empty()) { continue; }
+
+                // child mask bit j selects the upper half along axis split[j]
+                for (size_t mask = 0; mask < (static_cast<size_t>(1) << split.size()); mask++) {
+                    size_t at = childLows.size();
+                    childLows.insert(childLows.end(), lo, lo + dim);
+                    childHighs.insert(childHighs.end(), hi, hi + dim);
+
+                    for (size_t j = 0; j < split.size(); j++) {
+                        size_t i = split[j];
+                        double mid = (lo[i] + hi[i]) / 2;
+                        (mask >> j) & 1 ? childLows[at + i] = mid : childHighs[at + i] = mid;
+                    }
+                }
+            }
+
+            if (childLows.empty()) { return false; }
+
+            lows.swap(childLows);
+            highs.swap(childHighs);
+            scores.assign(lows.size() / dim, 0);
+            return true;
+        }
+    };
+
+    /* walks the step grid points of faces [first, last) of one dimension, addressed by per axis indices:
+       point k on axis i is left + k * step unless it is the last one, which is right.
+       A face fixes dim - faceDim axes at their first or last index; a point on several faces is
+       assigned to the one whose fixed axes are the first axes where it is extreme, so free axes
+       preceding a fixed one skip their extreme indices */
+    class FaceIterator : public ICompact::iterator {
+    public:
+        // C(dim, faceDim) * 2^(dim - faceDim), zero when it does not fit into size_t
+        static size_t faceCount(size_t dim, size_t faceDim) {
+            if (faceDim > dim) { return 0; }
+
+            size_t fixed = dim - faceDim;
+            if (fixed >= std::numeric_limits<size_t>::digits) { return 0; }
+
+            size_t count = binomial(dim, fixed);
+            if (count == 0 || count > (std::numeric_limits<size_t>::max() >> fixed)) { return 0; }
+            return count << fixed;
+        }
+
+        // perAxis - grid points per axis as given by ICompact::gridSize
+        static FaceIterator* create(IVector const* left, IVector const* right, IVector const* step, size_t const* perAxis,
+                                    size_t faceDim, size_t first, size_t last, ILogger *logger) {
+            auto dim = left->getDim();
+            auto current = left->clone();
+            auto it = new (std::nothrow) FaceIterator(dim, faceDim, last, current, logger);
+            if (current == nullptr || it == nullptr) {
+                if (logger != nullptr) {
+                    logger->log("in FaceIterator::create: no memory", RESULT_CODE::OUT_OF_MEMORY);
+                }
+                it != nullptr ? delete it : delete current;
+                return nullptr;
+            }
+
+            for (size_t i = 0; i < dim; i++) {
+                it->lo[i] = left->getCoord(i);
+                it->hi[i] = right->getCoord(i);
+                it->step[i] = step->getCoord(i);
+                it->counts[i] = perAxis[i];
+            }
+
+            it->face = first;
+            while (it->face < last && !it->setFace(it->face)) { it->face++; }
+            if (it->face >= last) {
+                if (logger != nullptr) {
+                    logger->log("in FaceIterator::create: no points of its own on the face", RESULT_CODE::NOT_FOUND);
+                }
+                delete it;
+                return nullptr;
+            }
+            it->moveToFirst();
+            return it;
+        }
+
+        // next point of the face, then the first point of the next face that has any
+        RESULT_CODE doStep() override {
+            if (face >= last) { return RESULT_CODE::OUT_OF_BOUNDS; }
+
+            size_t axis = 0;
+            while (axis < dim && index[axis] >= to[axis]) { axis++; }
+
+            if (axis == dim) {
+                do { face++; } while (face < last && !setFace(face));
+                if (face >= last) { return RESULT_CODE::OUT_OF_BOUNDS; }
+                moveToFirst();
+                return RESULT_CODE::SUCCESS;
+            }
+
+            for (size_t i = 0; i < axis; i++) { setIndex(i, from[i]); }
+            setIndex(axis, index[axis] + 1);
+            return RESULT_CODE::SUCCESS;
+        }
+
+        IVector* getPoint() const override { return current->clone(); }
+
+        IVector const* getCurrent() const override { return current; }
+
+        RESULT_CODE setDirection(IVector const* const) override {
+            if (logger != nullptr) {
+                logger->log("in FaceIterator::setDirection: faces are walked in a fixed order", RESULT_CODE::WRONG_ARGUMENT);
+            }
+            return RESULT_CODE::WRONG_ARGUMENT;
+        }
+
+        size_t getStateSize() const override { return 0; }
+
+        RESULT_CODE saveState(void*, size_t) const override {
+            if (logger != nullptr) {
+                logger->log("in FaceIterator::saveState: face iteration cannot be saved", RESULT_CODE::WRONG_ARGUMENT);
+            }
+            return RESULT_CODE::WRONG_ARGUMENT;
+        }
+
+        ~FaceIterator() override { delete current; }
+
+    private:
+        size_t dim, faceDim, face, last;
+        std::vector<double> lo, hi, step;
+        // index ranges [from, to] of the current face, fixed axes have from == to
+        std::vector<size_t> counts, from, to, index;
+        IVector *current;
+        ILogger *logger;
+
+        FaceIterator(size_t dim, size_t faceDim, size_t last, IVector *current, ILogger *logger):
+            dim(dim), faceDim(faceDim), face(0), last(last),
+            lo(dim), hi(dim), step(dim), counts(dim), from(dim), to(dim), index(dim),
+            current(current), logger(logger) {}
+
+        FaceIterator(const FaceIterator& other) = delete;
+        void operator=(const FaceIterator& other) = delete;
+
+        static size_t binomial(size_t n, size_t k) {
+            size_t result = 1;
+            for (size_t i = 1; i <= k; i++) {
+                if (result > std::numeric_limits<size_t>::max() / (n - k + i)) { return 0; }
+                result = result * (n - k + i) / i;
+            }
+            return result;
+        }
+
+        /* face f: the bits of f % 2^fixed choose the last index on the fixed axes,
+           f / 2^fixed is the number of the set of fixed axes in lexicographic order;
+           false when the face has no points of its own */
+        bool setFace(size_t f) {
+            size_t fixed = dim - faceDim, sides = f & ((static_cast<size_t>(1) << fixed) - 1);
+            size_t rank = f >> fixed;
+
+            std::vector<bool> isFixed(dim, false);
+            size_t lastFixed = 0, next = 0;
+            for (size_t j = 0; j < fixed; j++) {
+                for (size_t a = next; a < dim; a++) {
+                    size_t withA = binomial(dim - a - 1, fixed - j - 1);
+                    if (rank < withA) {
+                        isFixed[a] = true;
+                        lastFixed = a;
+                        next = a + 1;
+                        break;
+                    }
+                    rank -= withA;
+                }
+            }
+
+            bool empty = false;
+            for (size_t i = 0, j = 0; i < dim; i++) {
+                if (isFixed[i]) {
+                    bool upper = (sides >> j++) & 1;
+                    // on a single point axis the last index is the first one
+                    empty = empty || (upper && counts[i] == 1);
+                    from[i] = to[i] = upper ? counts[i] - 1 : 0;
+                } else if (fixed != 0 && i < lastFixed) {
+                    empty = empty || counts[i] < 3;
+                    from[i] = 1;
+                    to[i] = counts[i] - 2;
+                } else {
+                    from[i] = 0;
+                    to[i] = counts[i] - 1;
+                }
+            }
+            return !empty;
+        }
+
+        void setIndex(size_t i, size_t k) {
+            index[i] = k;
+            current->setCoord(i, gridCoord(lo[i], hi[i], step[i], k, counts[i]));
+        }
+
+        void moveToFirst() {
+            for (size_t i = 0; i < dim; i++) { setIndex(i, from[i]); }
+        }
+    };
+
+    // bounds never change after creation, so compacts and their iterators share them instead of copying
+    struct Bounds {
         IVector *left, *right;
+        // raw copies of the coordinates for the n-ary operations
+        std::vector<double> lo, hi;
+
+        Bounds(IVector *left, IVector *right): left(left), right(right),
+            lo(left->getDim()), hi(left->getDim()) {
+            for (size_t i = 0; i < lo.size(); i++) {
+                lo[i] = left->getCoord(i);
+                hi[i] = right->getCoord(i);
+            }
+        }
+        ~Bounds() {
+            delete left;
+            delete right;
+        }
+
+        Bounds(Bounds const& other) = delete;
+        Bounds& operator=(Bounds const& other) = delete;
+    };
+
+    class CompactImpl: public ICompact {
+    private:
+        std::shared_ptr<Bounds const> bounds;
+        // begin - left, end - right, both owned by bounds
+        IVector const *left, *right;
         size_t dim;
         ILogger *logger;
 
         CompactImpl(CompactImpl const& set) = delete;
         CompactImpl& operator=(CompactImpl const& set) = delete;
 
-        bool isCorrectStep(IVector const* const step, bool reverse) {
+        bool isCorrectStep(IVector const* const step, bool reverse) const {
             if (step == nullptr) { return false; }
 
             if (step->getDim() != dim) { return false; }
@@ -63,13 +676,112 @@ namespace {
             return true;
         }
 
+        // points the iterator visits on one axis: begin, begin + step, ... while inside,
+        // then end itself unless the last of them is already within tolerance of it;
+        // zero when the count does not fit into size_t
+        static size_t axisCount(double length, double step) {
+            if (length < tolerance) { return 1; }
+
+            double steps = std::floor((length + tolerance) / step);
+            if (!(steps < static_cast<double>(std::numeric_limits<size_t>::max() / 2))) { return 0; }
+
+            auto count = static_cast<size_t>(steps) + 1;
+            if (length - steps * step >= tolerance) { count++; }
+            return count;
+        }
+
+        ICompact::iterator* beginFaceRange(IVector const* const step, size_t faceDim, size_t first, size_t last) {
+            if (!isCorrectStep(step, false) || faceDim > dim || first >= last) {
+                if (logger != nullptr) {
+                    logger->log("in CompactImpl::beginFaces: incorrect step or face dimension", RESULT_CODE::WRONG_ARGUMENT);
+                }
+                return nullptr;
+            }
+
+            // the points of the faces may be countable even when the whole grid is not
+            size_t total;
+            std::vector<size_t> perAxis(dim);
+            auto rc = gridSize(step, perAxis.data(), total);
+            if (rc != RESULT_CODE::SUCCESS && rc != RESULT_CODE::OUT_OF_BOUNDS) { return nullptr; }
+            for (size_t i = 0; i < dim; i++) {
+                if (perAxis[i] == 0) {
+                    if (logger != nullptr) {
+                        logger->log("in CompactImpl::beginFaces: too many points on axis", RESULT_CODE::OUT_OF_BOUNDS);
+                    }
+                    return nullptr;
+                }
+            }
+
+            return FaceIterator::create(left, right, step, perAxis.data(), faceDim, first, last, logger);
+        }
+
+        // writes points [from, to) of every column, the file is already of its full size
+        RESULT_CODE writeColumns(char const* path, GridFileHeader const& header, double const* step,
+                                 size_t const* perAxis, size_t from, size_t to) const {
+            const size_t chunk = 1 << 16;
+            std::vector<double> buffer(std::min(chunk, to - from));
+            std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+
+            size_t stride = 1;
+            for (size_t i = 0; i < dim && file.good(); i++) {
+                auto count = perAxis[i];
+                double lo = bounds->lo[i], hi = bounds->hi[i];
+                // index of point <from> on this axis and how far into its run of <stride> equal values it is
+                size_t k = (from / stride) % count, run = from % stride;
+
+                file.seekp(static_cast<std::streamoff>(header.dataOffset + (i * header.points + from) * sizeof(double)));
+                for (size_t p = from; p < to && file.good(); p += buffer.size()) {
+                    size_t n = std::min(buffer.size(), to - p);
+                    for (size_t j = 0; j < n; j++) {
+                        buffer[j] = gridCoord(lo, hi, step[i], k, count);
+                        if (++run == stride) {
+                            run = 0;
+                            if (++k == count) { k = 0; }
+                        }
+                    }
+                    file.write(reinterpret_cast<char const*>(buffer.data()), static_cast<std::streamsize>(n * sizeof(double)));
+                }
+                stride *= count;
+            }
+
+            file.close();
+            return file.fail() ? RESULT_CODE::FILE_ERROR : RESULT_CODE::SUCCESS;
+        }
+
     public:
         constexpr static const double tolerance = 1e-6;
 
-        CompactImpl(IVector *left, IVector *right, ILogger *logger):
-            left(left->clone()), right(right->clone()),
+        CompactImpl(std::shared_ptr<Bounds const> const& bounds, ILogger *logger):
+            bounds(bounds), left(bounds->left), right(bounds->right),
             dim(left->getDim()), logger(logger) {}
 
+        // the only place where bounds are copied
+        static CompactImpl* create(IVector const* begin, IVector const* end, ILogger *logger) {
+            auto
+                    left = begin->clone(),
+                    right = end->clone();
+
+            Bounds *bounds = nullptr;
+            if (left != nullptr && right != nullptr) {
+                bounds = new (std::nothrow) Bounds(left, right);
+            }
+
+            if (bounds == nullptr) {
+                if (logger != nullptr) {
+                    logger->log("in CompactImpl::create: no memory", RESULT_CODE::OUT_OF_MEMORY);
+                }
+                delete left;
+                delete right;
+                return nullptr;
+            }
+
+            auto c = new (std::nothrow) CompactImpl(std::shared_ptr<Bounds const>(bounds), logger);
+            if (c == nullptr && logger != nullptr) {
+                logger->log("in CompactImpl::create: no memory", RESULT_CODE::OUT_OF_MEMORY);
+            }
+            return c;
+        }
+
         IVector* getBegin() const override { return left->clone(); }
 
         IVector* getEnd() const override { return right->clone(); }
@@ -108,6 +820,71 @@ namespace {
             return it;
         }
 
+        iterator* beginLatinHypercube(size_t samples, unsigned long long seed) override {
+            return SampleIterator::create(left, right, samples, seed, SampleIterator::Design::LATIN_HYPERCUBE, logger);
+        }
+
+        iterator* beginStratified(size_t samples, unsigned long long seed) override {
+            return SampleIterator::create(left, right, samples, seed, SampleIterator::Design::STRATIFIED, logger);
+        }
+
+        ICompact::iterator* beginAdaptive(IVector const* const step, ScoreCallback score, void* pContext, double keepRatio) override {
+            return AdaptiveIterator::create(left, right, step, score, pContext, keepRatio, logger);
+        }
+
+        size_t faceCount(size_t faceDim) const override { return FaceIterator::faceCount(dim, faceDim); }
+
+        iterator* beginFaces(IVector const* const step, size_t faceDim) override {
+            return beginFaceRange(step, faceDim, 0, faceCount(faceDim));
+        }
+
+        iterator* beginFace(IVector const* const step, size_t faceDim, size_t face) override {
+            if (face >= faceCount(faceDim)) {
+                if (logger != nullptr) {
+                    logger->log("in CompactImpl::beginFace: no such face", RESULT_CODE::OUT_OF_BOUNDS);
+                }
+                return nullptr;
+            }
+            return beginFaceRange(step, faceDim, face, face + 1);
+        }
+
+        ICompact::iterator* restore(void const* pState, size_t size) override {
+            IteratorState state;
+            if (pState == nullptr || size < sizeof(state)) {
+                if (logger != nullptr) {
+                    logger->log("in CompactImpl::restore: truncated state", RESULT_CODE::BAD_REFERENCE);
+                }
+                return nullptr;
+            }
+
+            memcpy(&state, pState, sizeof(state));
+            if (state.magic != IteratorState::signature) {
+                if (logger != nullptr) {
+                    logger->log("in CompactImpl::restore: not an iterator state", RESULT_CODE::WRONG_ARGUMENT);
+                }
+                return nullptr;
+            }
+
+            if (state.dim != dim) {
+                if (logger != nullptr) {
+                    logger->log("in CompactImpl::restore: dimension mismatch", RESULT_CODE::WRONG_DIM);
+                }
+                return nullptr;
+            }
+
+            switch (state.kind) {
+            case IteratorState::SAMPLE:
+                return SampleIterator::restore(left, right, state, logger);
+            case IteratorState::GRID:
+                return iterator::restore(this, state, static_cast<char const*>(pState) + sizeof(state), size - sizeof(state), logger);
+            default:
+                if (logger != nullptr) {
+                    logger->log("in CompactImpl::restore: unknown iterator kind", RESULT_CODE::WRONG_ARGUMENT);
+                }
+                return nullptr;
+            }
+        }
+
         RESULT_CODE isContains(IVector const* const vec, bool& result) const override {
             if (vec == nullptr) {
                 if (logger != nullptr) {
@@ -174,10 +951,199 @@ namespace {
             return RESULT_CODE::SUCCESS;
         }
 
+        RESULT_CODE gridSize(IVector const* const step, size_t* perAxis, size_t& total) const override {
+            if (step == nullptr || step->getDim() != dim) {
+                if (logger != nullptr) {
+                    logger->log("in CompactImpl::gridSize: null step or dimension mismatch", RESULT_CODE::WRONG_DIM);
+                }
+                return RESULT_CODE::WRONG_DIM;
+            }
+
+            bool overflow = false;
+            total = 1;
+            for (size_t i = 0; i < dim; i++) {
+                double stp = std::abs(step->getCoord(i));
+                if (std::isnan(stp) || stp < tolerance) {
+                    if (logger != nullptr) {
+                        logger->log("in CompactImpl::gridSize: incorrect step", RESULT_CODE::WRONG_ARGUMENT);
+                    }
+                    return RESULT_CODE::WRONG_ARGUMENT;
+                }
+
+                auto count = axisCount(right->getCoord(i) - left->getCoord(i), stp);
+                if (perAxis != nullptr) { perAxis[i] = count; }
+
+                if (count == 0 || total > std::numeric_limits<size_t>::max() / count) {
+                    overflow = true;
+                } else {
+                    total *= count;
+                }
+            }
+
+            if (overflow) {
+                total = std::numeric_limits<size_t>::max();
+                if (logger != nullptr) {
+                    logger->log("in CompactImpl::gridSize: too many points", RESULT_CODE::OUT_OF_BOUNDS);
+                }
+                return RESULT_CODE::OUT_OF_BOUNDS;
+            }
+            return RESULT_CODE::SUCCESS;
+        }
+
+        RESULT_CODE estimateCost(IVector const* const step, double secondsPerPoint, double& seconds) const override {
+            if (std::isnan(secondsPerPoint) || secondsPerPoint < 0) {
+                if (logger != nullptr) {
+                    logger->log("in CompactImpl::estimateCost: incorrect time of evaluation", RESULT_CODE::WRONG_ARGUMENT);
+                }
+                return RESULT_CODE::WRONG_ARGUMENT;
+            }
+
+            size_t total;
+            size_t *perAxis = new (std::nothrow) size_t[dim];
+            if (perAxis == nullptr) {
+                if (logger != nullptr) {
+                    logger->log("in CompactImpl::estimateCost: no memory", RESULT_CODE::OUT_OF_MEMORY);
+                }
+                return RESULT_CODE::OUT_OF_MEMORY;
+            }
+
+            auto rc = gridSize(step, perAxis, total);
+            if (rc == RESULT_CODE::SUCCESS || rc == RESULT_CODE::OUT_OF_BOUNDS) {
+                // in doubles, so that grids too large to count still get an (infinite at worst) estimate
+                seconds = secondsPerPoint;
+                for (size_t i = 0; i < dim && seconds != 0; i++) {
+                    seconds *= perAxis[i] != 0 ? static_cast<double>(perAxis[i]) : std::numeric_limits<double>::infinity();
+                }
+                rc = RESULT_CODE::SUCCESS;
+            }
+            delete[] perAxis;
+            return rc;
+        }
+
+        RESULT_CODE exportGrid(IVector const* const step, char const* path, size_t partitions) const override {
+            if (path == nullptr) {
+                if (logger != nullptr) {
+                    logger->log("in CompactImpl::exportGrid: null path", RESULT_CODE::BAD_REFERENCE);
+                }
+                return RESULT_CODE::BAD_REFERENCE;
+            }
+
+            if (!isCorrectStep(step, false)) {
+                if (logger != nullptr) {
+                    logger->log("in CompactImpl::exportGrid: incorrect step", RESULT_CODE::WRONG_ARGUMENT);
+                }
+                return RESULT_CODE::WRONG_ARGUMENT;
+            }
+
+            size_t total;
+            std::vector<size_t> perAxis(dim);
+            auto rc = gridSize(step, perAxis.data(), total);
+            if (rc != RESULT_CODE::SUCCESS) { return rc; }
+
+            GridFileHeader header = {};
+            header.magic = GridFileHeader::signature;
+            header.version = GridFileHeader::currentVersion;
+            header.dim = dim;
+            header.points = total;
+
+            size_t described = sizeof(header) + 3 * dim * sizeof(double) + dim * sizeof(unsigned long long);
+            header.dataOffset = (described + GridFileHeader::alignment - 1) / GridFileHeader::alignment * GridFileHeader::alignment;
+            if (total > (std::numeric_limits<unsigned long long>::max() - header.dataOffset) / sizeof(double) / dim) {
+                if (logger != nullptr) {
+                    logger->log("in CompactImpl::exportGrid: grid is too large for a file", RESULT_CODE::OUT_OF_BOUNDS);
+                }
+                return RESULT_CODE::OUT_OF_BOUNDS;
+            }
+
+            std::vector<char> head(header.dataOffset, 0);
+            memcpy(head.data(), &header, sizeof(header));
+            auto coords = reinterpret_cast<double*>(head.data() + sizeof(header));
+            auto counts = reinterpret_cast<unsigned long long*>(coords + 3 * dim);
+            std::vector<double> steps(dim);
+            for (size_t i = 0; i < dim; i++) {
+                steps[i] = step->getCoord(i);
+                coords[i] = bounds->lo[i];
+                coords[dim + i] = bounds->hi[i];
+                coords[2 * dim + i] = steps[i];
+                counts[i] = perAxis[i];
+            }
+
+            // header first, then the file is extended to its full size so that the slices may be written in any order
+            {
+                std::ofstream file(path, std::ios::out | std::ios::binary | std::ios::trunc);
+                file.write(head.data(), static_cast<std::streamsize>(head.size()));
+                file.seekp(static_cast<std::streamoff>(header.dataOffset + dim * total * sizeof(double) - 1));
+                file.put(0);
+                file.close();
+                if (file.fail()) {
+                    if (logger != nullptr) {
+                        logger->log("in CompactImpl::exportGrid: cannot create file", RESULT_CODE::FILE_ERROR);
+                    }
+                    return RESULT_CODE::FILE_ERROR;
+                }
+            }
+
+            partitions = std::max<size_t>(1, std::min(partitions, total));
+            size_t slice = (total + partitions - 1) / partitions;
+            std::vector<RESULT_CODE> results(partitions, RESULT_CODE::SUCCESS);
+            parallelFor(partitions, 1, [&](size_t from, size_t to) {
+                for (size_t n = from; n < to && n * slice < total; n++) {
+                    results[n] = writeColumns(path, header, steps.data(), perAxis.data(), n * slice, std::min(total, (n + 1) * slice));
+                }
+            });
+
+            for (auto result: results) {
+                if (result != RESULT_CODE::SUCCESS) {
+                    if (logger != nullptr) {
+                        logger->log("in CompactImpl::exportGrid: write failed", result);
+                    }
+                    return result;
+                }
+            }
+            return RESULT_CODE::SUCCESS;
+        }
+
         size_t getDim() const override { return dim; }
 
+        /* intersect: lo = max of begins, hi = min of ends, otherwise lo = min of begins, hi = max of ends;
+           lo and hi are getDim() long and initialized with the bounds of the first compact */
+        static void fold(ICompact const* const* compacts, size_t count, bool intersect, double *lo, double *hi) {
+            auto dim = compacts[0]->getDim();
+
+            for (size_t k = 0; k < count; k++) {
+                auto impl = dynamic_cast<CompactImpl const*>(compacts[k]);
+                if (impl != nullptr) {
+                    double const *l = impl->bounds->lo.data(), *h = impl->bounds->hi.data();
+                    if (intersect) {
+                        for (size_t i = 0; i < dim; i++) {
+                            lo[i] = std::max(lo[i], l[i]);
+                            hi[i] = std::min(hi[i], h[i]);
+                        }
+                    } else {
+                        for (size_t i = 0; i < dim; i++) {
+                            lo[i] = std::min(lo[i], l[i]);
+                            hi[i] = std::max(hi[i], h[i]);
+                        }
+                    }
+                    continue;
+                }
+
+                // foreign implementation, go through the interface
+                auto
+                        beg = compacts[k]->getBegin(),
+                        end = compacts[k]->getEnd();
+                for (size_t i = 0; i < dim && beg != nullptr && end != nullptr; i++) {
+                    lo[i] = intersect ? std::max(lo[i], beg->getCoord(i)) : std::min(lo[i], beg->getCoord(i));
+                    hi[i] = intersect ? std::min(hi[i], end->getCoord(i)) : std::max(hi[i], end->getCoord(i));
+                }
+                delete beg;
+                delete end;
+            }
+        }
+
+        // shares the bounds, no vector is copied
         ICompact* clone() const override {
-            auto c = new (std::nothrow) CompactImpl(left, right, logger);
+            auto c = new (std::nothrow) CompactImpl(bounds, logger);
             if (c == nullptr) {
                 if (logger != nullptr) {
                     logger->log("in CompactImpl::clone", RESULT_CODE::OUT_OF_MEMORY);
@@ -186,10 +1152,7 @@ namespace {
             return c;
         }
 
-        ~CompactImpl() override {
-            delete left;
-            delete right;
-        }
+        ~CompactImpl() override = default;
 
         class iterator : public ICompact::iterator {
             friend class CompactImpl;
@@ -197,7 +1160,8 @@ namespace {
             ILogger *logger;
 
             bool reverse;
-            ICompact const *compact;
+            std::shared_ptr<Bounds const> bounds;
+            size_t dim;
             IVector *current;
             IVector *dir;
             IVector const *step;
@@ -218,11 +1182,10 @@ namespace {
                 return true;
             }
         public:
-            iterator(ICompact const *compact, IVector const *step, ILogger *logger, bool reverse = false):
-                    logger(logger), reverse(reverse), compact(compact->clone()),
-                    current(!reverse ? compact->getBegin()->clone() : compact->getEnd()->clone()) {
+            iterator(CompactImpl const *compact, IVector const *step, ILogger *logger, bool reverse = false):
+                    logger(logger), reverse(reverse), bounds(compact->bounds), dim(compact->dim),
+                    current(!reverse ? compact->left->clone() : compact->right->clone()) {
                 const double stp = tolerance * 10;
-                auto dim = compact->getDim();
                 double *data = new double[dim];
 
                 if (step == nullptr) {
@@ -234,7 +1197,7 @@ namespace {
                 this->step = step->clone();
 
                 for (size_t i = 0; i < dim; i++) { data[i] = i; }
-                dir = IVector::createVector(compact->getDim(), data, logger);
+                dir = IVector::createVector(dim, data, logger);
                 delete[] data;
             }
 
@@ -243,23 +1206,19 @@ namespace {
                 bool done = false;
 
                 auto
-                        begin = compact->getBegin(),
-                        end = compact->getEnd();
+                        begin = bounds->left,
+                        end = bounds->right;
 
                 bool eq;
                 auto rc = !reverse ? IVector::equals(end, current, IVector::NORM::NORM_2, tolerance, &eq, logger) :
                                      IVector::equals(begin, current, IVector::NORM::NORM_2, tolerance, &eq, logger);
 
                 if (eq || rc != RESULT_CODE::SUCCESS) {
-                    delete begin;
-                    delete end;
                     return RESULT_CODE::OUT_OF_BOUNDS;
                 }
 
                 IVector *v = current->clone();
 
-                auto dim = compact->getDim();
-
                 for (size_t i = 0, idx = 0; i < dim && !done; i++) {
                     idx = static_cast<size_t>(std::round(dir->getCoord(i)));
 
@@ -275,10 +1234,7 @@ namespace {
                         }
                     }
 
-                    v->setCoord(idx, v->getCoord(idx) + step->getCoord(idx));
-
-                    bool contains;
-                    auto rc = compact->isContains(v, contains);
+                    auto rc = v->setCoord(idx, v->getCoord(idx) + step->getCoord(idx));
 
                     if (rc != RESULT_CODE::SUCCESS) {
                         if (logger != nullptr) {
@@ -288,7 +1244,7 @@ namespace {
                         return rc;
                     }
 
-                    if (!contains) {
+                    if (!isLess(begin, v) || !isLess(v, end)) {
                         !reverse ? v->setCoord(idx, end->getCoord(idx)) : v->setCoord(idx, begin->getCoord(idx));
                     }
 
@@ -307,17 +1263,17 @@ namespace {
 
             IVector* getPoint() const override { return current->clone(); }
 
+            IVector const* getCurrent() const override { return current; }
+
             // change order of step
             RESULT_CODE setDirection(IVector const* const dir) override {
-                if (dir->getDim() != compact->getDim()) {
+                if (dir->getDim() != dim) {
                     if (logger != nullptr) {
                         logger->log("in CompactImpl::iterator::setDirection: dimension mismatch", RESULT_CODE::WRONG_DIM);
                     }
                     return RESULT_CODE::WRONG_DIM;
                 }
 
-                auto dim = dir ->getDim();
-
                 for (size_t i = 0; i < dim; i++) {
                     if (!checkUnique(dir, dim, i)) {
                         if (logger != nullptr) {
@@ -327,7 +1283,6 @@ namespace {
                     }
                 }
 
-                dim = compact->getDim();
                 for (size_t i = 0; i < dim; i++) {
                     auto coord = dir->getCoord(i);
                     if (std::abs(coord - std::round(coord)) > tolerance) {
@@ -340,16 +1295,94 @@ namespace {
                 }
 
                 delete current;
-                current = !reverse ? compact->getBegin() : compact->getEnd();
+                current = !reverse ? bounds->left->clone() : bounds->right->clone();
 
                 return RESULT_CODE::SUCCESS;
             }
 
+            size_t getStateSize() const override {
+                return sizeof(IteratorState) + 3 * dim * sizeof(double);
+            }
+
+            RESULT_CODE saveState(void* pBuffer, size_t size) const override {
+                if (pBuffer == nullptr || size < getStateSize()) {
+                    if (logger != nullptr) {
+                        logger->log("in CompactImpl::iterator::saveState: buffer is too small", RESULT_CODE::BAD_REFERENCE);
+                    }
+                    return RESULT_CODE::BAD_REFERENCE;
+                }
+
+                IteratorState state = {};
+                state.magic = IteratorState::signature;
+                state.kind = IteratorState::GRID;
+                state.dim = dim;
+                state.reverse = reverse;
+
+                memcpy(pBuffer, &state, sizeof(state));
+                auto coords = reinterpret_cast<double*>(static_cast<char*>(pBuffer) + sizeof(state));
+                for (size_t i = 0; i < dim; i++) {
+                    coords[i] = current->getCoord(i);
+                    coords[dim + i] = dir->getCoord(i);
+                    coords[2 * dim + i] = step->getCoord(i);
+                }
+                return RESULT_CODE::SUCCESS;
+            }
+
+            static iterator* restore(CompactImpl *compact, IteratorState const& state,
+                                     char const* pCoords, size_t size, ILogger *logger) {
+                auto dim = compact->getDim();
+                if (size < 3 * dim * sizeof(double)) {
+                    if (logger != nullptr) {
+                        logger->log("in CompactImpl::iterator::restore: truncated state", RESULT_CODE::BAD_REFERENCE);
+                    }
+                    return nullptr;
+                }
+
+                double *data = new (std::nothrow) double[3 * dim];
+                if (data == nullptr) {
+                    if (logger != nullptr) {
+                        logger->log("in CompactImpl::iterator::restore: no memory", RESULT_CODE::OUT_OF_MEMORY);
+                    }
+                    return nullptr;
+                }
+                memcpy(data, pCoords, 3 * dim * sizeof(double));
+
+                auto
+                        cur = IVector::createVector(dim, data, logger),
+                        dir = IVector::createVector(dim, data + dim, logger),
+                        step = IVector::createVector(dim, data + 2 * dim, logger);
+                delete[] data;
+
+                iterator *it = nullptr;
+                bool contains = false;
+                if (cur != nullptr && dir != nullptr && step != nullptr
+                        && compact->isContains(cur, contains) == RESULT_CODE::SUCCESS && contains
+                        && compact->isCorrectStep(step, state.reverse != 0)) {
+                    it = new (std::nothrow) iterator(compact, step, logger, state.reverse != 0);
+                }
+
+                if (it != nullptr && it->setDirection(dir) == RESULT_CODE::SUCCESS) {
+                    for (size_t i = 0; i < dim; i++) {
+                        it->current->setCoord(i, cur->getCoord(i));
+                    }
+                } else {
+                    if (logger != nullptr) {
+                        logger->log("in CompactImpl::iterator::restore: inconsistent state", RESULT_CODE::WRONG_ARGUMENT);
+                    }
+                    delete it;
+                    it = nullptr;
+                }
+
+                delete cur;
+                delete dir;
+                delete step;
+                return it;
+            }
+
             ~iterator() override {
                 delete dir;
                 delete step;
                 delete current;
-                delete compact;
             }
         };
     };
@@ -373,7 +1406,7 @@ ICompact* ICompact::createCompact(IVector const* const begin, IVector const* con
     }
 
     // begin < end!
-    return new (std::nothrow) CompactImpl(const_cast<IVector *>(begin), const_cast<IVector *>(end), logger);
+    return CompactImpl::create(begin, end, logger);
 }
 
 ICompact * ICompact::intersection(ICompact const* const left, ICompact const* const right, ILogger* logger) {
@@ -384,61 +1417,89 @@ ICompact * ICompact::intersection(ICompact const* const left, ICompact const* co
         return nullptr;
     }
 
-    auto dim = left->getDim();
+    ICompact const* operands[] = {left, right};
+    return intersectionOf(operands, 2, logger);
+}
 
-    bool inters;
-    auto rc = left->isIntersects(right, inters);
+static bool isValidData(ICompact const* const* compacts, size_t count) {
+    if (compacts == nullptr || count == 0 || compacts[0] == nullptr) { return false; }
 
-    if (rc != RESULT_CODE::SUCCESS) {
-        if (logger != nullptr) {
-            logger->log("in ICompact::intersection", RESULT_CODE::BAD_REFERENCE);
-        }
-        return nullptr;
+    for (size_t k = 1; k < count; k++) {
+        if (!isValidData(compacts[0], compacts[k])) { return false; }
     }
+    return true;
+}
 
-    if (!inters) {
+// n-ary fold of the bounds into a new compact
+static ICompact* foldCompacts(ICompact const* const* compacts, size_t count, bool intersect, ILogger* logger) {
+    auto dim = compacts[0]->getDim();
+    auto *data = new (std::nothrow) double[2 * dim];
+    if (data == nullptr) {
         if (logger != nullptr) {
-            logger->log("in ICompact::intersecton: cannot intersect", RESULT_CODE::WRONG_ARGUMENT);
+            logger->log("in ICompact::foldCompacts", RESULT_CODE::OUT_OF_MEMORY);
         }
         return nullptr;
     }
 
-    auto *data = new (std::nothrow) double[dim]{0};
-    if (data == nullptr) {
+    auto
+            beg = compacts[0]->getBegin(),
+            end = compacts[0]->getEnd();
+    if (beg == nullptr || end == nullptr) {
+        delete beg;
+        delete end;
+        delete[] data;
         if (logger != nullptr) {
-            logger->log("in ICompact::intersection", RESULT_CODE::OUT_OF_MEMORY);
+            logger->log("in ICompact::foldCompacts: bad bounds", RESULT_CODE::BAD_REFERENCE);
         }
         return nullptr;
     }
 
-    auto
-            l = IVector::createVector(dim, data, logger),
-            r = IVector::createVector(dim, data, logger);
+    double *lo = data, *hi = data + dim;
+    for (size_t i = 0; i < dim; i++) {
+        lo[i] = beg->getCoord(i);
+        hi[i] = end->getCoord(i);
+    }
+    CompactImpl::fold(compacts, count, intersect, lo, hi);
 
+    ICompact *c = nullptr;
+    for (size_t i = 0; i < dim; i++) {
+        beg->setCoord(i, lo[i]);
+        end->setCoord(i, hi[i]);
+    }
     delete[] data;
 
-    auto
-            lbeg = left->getBegin(),
-            rbeg = right->getBegin(),
-            lend = left->getEnd(),
-            rend = right->getEnd();
-
-    for (size_t i = 0; i < dim; i++) {
-        l->setCoord(i, std::max(lbeg->getCoord(i), rbeg->getCoord(i)));
-        r->setCoord(i, std::min(lend->getCoord(i), rend->getCoord(i)));
+    // an empty intersection has begin > end on some axis
+    if (isLess(beg, end)) {
+        c = ICompact::createCompact(beg, end, logger);
+    } else if (logger != nullptr) {
+        logger->log("in ICompact::intersecton: cannot intersect", RESULT_CODE::WRONG_ARGUMENT);
     }
 
-    delete lbeg;
-    delete lend;
-    delete rbeg;
-    delete rend;
+    delete beg;
+    delete end;
+    return c;
+}
 
-    auto c = createCompact(l, r, logger);
+ICompact* ICompact::intersectionOf(ICompact const* const* compacts, size_t count, ILogger* logger) {
+    if (!isValidData(compacts, count)) {
+        if (logger != nullptr) {
+            logger->log("in ICompact::intersectionOf: null param or dimension mismatch", RESULT_CODE::BAD_REFERENCE);
+        }
+        return nullptr;
+    }
 
-    delete l;
-    delete r;
+    return foldCompacts(compacts, count, true, logger);
+}
 
-    return c;
+ICompact* ICompact::convexHullOf(ICompact const* const* compacts, size_t count, ILogger* logger) {
+    if (!isValidData(compacts, count)) {
+        if (logger != nullptr) {
+            logger->log("in ICompact::convexHullOf: null param or dimension mismatch", RESULT_CODE::BAD_REFERENCE);
+        }
+        return nullptr;
+    }
+
+    return foldCompacts(compacts, count, false, logger);
 }
 
 static bool compactIsInCompact(IVector const* const beg1, IVector const* const end1,
@@ -581,18 +1642,6 @@ ICompact * ICompact::makeConvex(ICompact const* const left, ICompact const* cons
         return nullptr;
     }
 
-    auto
-            lbeg = left->getBegin(),
-            rbeg = right->getBegin(),
-            lend = left->getEnd(),
-            rend = right->getEnd();
-
-    auto c = createCompact(min(lbeg, rbeg), max(lend, rend), logger);
-
-    delete lbeg;
-    delete lend;
-    delete rbeg;
-    delete rend;
-
-    return c;
+    ICompact const* operands[] = {left, right};
+    return convexHullOf(operands, 2, logger);
 }
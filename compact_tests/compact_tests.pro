@@ -12,7 +12,8 @@ HEADERS += \
     include/RC.h \
     include/ILogger.h \
     include/IVector.h \
-    include/ICompact.h
+    include/ICompact.h \
+    include/CompactRange.h
 
 LIBS += \
     -L$$PWD/libs/ -llogger \
@@ -2,11 +2,14 @@
 #include <cmath>
 #include <array>
 #include <cassert>
+#include <algorithm>
+#include <vector>
 
 #include "include/test.h"
 #include "include/ILogger.h"
 #include "include/IVector.h"
 #include "include/ICompact.h"
+#include "include/CompactRange.h"
 
 #define CLIENT(n) ((void*) n)
 #define CLIENT_KEY 47
@@ -196,6 +199,34 @@ static void testClone(ICompact* c, ILogger* logger) {
     delete compactClone;
 }
 
+static size_t countPoints(ICompact::iterator* it) {
+    if (it == nullptr) { return 0; }
+
+    size_t count = 1;
+    while (it->doStep() == RESULT_CODE::SUCCESS) { count++; }
+    return count;
+}
+
+// clones and iterators share bounds with the original, they must stay valid after it is deleted
+static void testSharedBounds(ILogger* logger) {
+    auto original = createCompact<DIM, DIM>(&beginData_1, &endData_1, logger);
+    if (original == nullptr) { return; }
+
+    array<double, DIM> stepData = {0.5, 0.5, 0.5};
+    auto step = IVector::createVector(DIM, stepData.data(), logger);
+
+    auto copy = original->clone();
+    auto it = original->begin(step);
+    delete original;
+
+    test("Clone outlives original", isTrue, checkCompact<DIM>(copy, beginData_1, endData_1, logger));
+    test("Iterator outlives compact", isTrue, countPoints(it) == 27);
+
+    delete it;
+    delete copy;
+    delete step;
+}
+
 static void testIsContains(ICompact* c, ILogger* logger) {
     assert(c);
 
@@ -305,6 +336,477 @@ static void testConvex(ICompact* c1, ICompact* c2, ILogger* logger) {
     delete convh;
 }
 
+static bool isSameCompact(ICompact* a, ICompact* b) {
+    if (a == nullptr || b == nullptr) { return false; }
+
+    auto ab = a->getBegin(), ae = a->getEnd(), bb = b->getBegin(), be = b->getEnd();
+    bool same = ab && ae && bb && be;
+    for (size_t i = 0; same && i < a->getDim(); i++) {
+        same = ab->getCoord(i) == bb->getCoord(i) && ae->getCoord(i) == be->getCoord(i);
+    }
+    delete ab;
+    delete ae;
+    delete bb;
+    delete be;
+    return same;
+}
+
+// n-ary operations agree with the chained binary ones
+static void testFold(ICompact* c1, ICompact* c2, ICompact* c3, ILogger* logger) {
+    ICompact const* all[] = {c1, c2, c3};
+
+    auto inters_12 = ICompact::intersection(c1, c2, logger);
+    auto inters = inters_12 ? ICompact::intersection(inters_12, c3, nullptr) : nullptr;
+    auto intersOf = ICompact::intersectionOf(all, 3, nullptr);
+    test("N-ary intersection of compacts", isTrue, inters == nullptr ? intersOf == nullptr : isSameCompact(inters, intersOf));
+
+    auto conv_12 = ICompact::makeConvex(c1, c2, logger);
+    auto conv = conv_12 ? ICompact::makeConvex(conv_12, c3, logger) : nullptr;
+    auto convOf = ICompact::convexHullOf(all, 3, logger);
+    test("N-ary convex hull of compacts", isTrue, isSameCompact(conv, convOf));
+
+    auto single = ICompact::convexHullOf(all, 1, logger);
+    test("N-ary convex hull of one compact", isTrue, isSameCompact(single, c1));
+
+    ICompact const* withNull[] = {c1, nullptr};
+    auto bad = ICompact::intersectionOf(withNull, 2, nullptr);
+    test("N-ary intersection with null", isBad<ICompact>, bad);
+    delete bad;
+    bad = ICompact::convexHullOf(all, 0, nullptr);
+    test("N-ary convex hull of nothing", isBad<ICompact>, bad);
+    delete bad;
+
+    delete inters_12;
+    delete inters;
+    delete intersOf;
+    delete conv_12;
+    delete conv;
+    delete convOf;
+    delete single;
+}
+
+// walks a sampling iterator and checks that every point lies in the compact
+// and that every axis stratum of width 1 / strata is hit exactly <perStratum> times
+static bool checkSampling(ICompact* c, ICompact::iterator* it, size_t count, size_t strata, size_t perStratum) {
+    if (it == nullptr) { return false; }
+
+    size_t hits[DIM][64] = {{0}};
+    size_t points = 0;
+    bool ok = strata <= 64;
+
+    auto beg = c->getBegin(), end = c->getEnd();
+    do {
+        auto point = it->getPoint();
+        bool contains = false;
+
+        if (point == nullptr || c->isContains(point, contains) != RESULT_CODE::SUCCESS || !contains) {
+            ok = false;
+        } else {
+            for (size_t i = 0; i < DIM && ok; ++i) {
+                double t = (point->getCoord(i) - beg->getCoord(i)) / (end->getCoord(i) - beg->getCoord(i));
+                hits[i][std::min(strata - 1, static_cast<size_t>(t * strata))]++;
+            }
+        }
+        delete point;
+        points++;
+    } while (ok && it->doStep() == RESULT_CODE::SUCCESS);
+    delete beg;
+    delete end;
+
+    for (size_t i = 0; i < DIM && ok; ++i) {
+        for (size_t k = 0; k < strata; ++k) {
+            ok = ok && hits[i][k] == perStratum;
+        }
+    }
+    return ok && points == count;
+}
+
+static bool isSameSequence(ICompact::iterator* it1, ICompact::iterator* it2, ILogger* logger) {
+    if (it1 == nullptr || it2 == nullptr) { return false; }
+
+    RESULT_CODE rc1, rc2;
+    do {
+        bool eq = false;
+        auto p1 = it1->getPoint(), p2 = it2->getPoint();
+        auto rc = IVector::equals(p1, p2, IVector::NORM::NORM_INF, tolerance, &eq, logger);
+        delete p1;
+        delete p2;
+
+        if (rc != RESULT_CODE::SUCCESS || !eq) { return false; }
+
+        rc1 = it1->doStep();
+        rc2 = it2->doStep();
+    } while (rc1 == RESULT_CODE::SUCCESS && rc2 == RESULT_CODE::SUCCESS);
+
+    return rc1 == rc2;
+}
+
+static void testSampling(ICompact* c, ILogger* logger) {
+    assert(c);
+
+    const size_t samples = 16;
+    auto lhs = c->beginLatinHypercube(samples, 42);
+    test("Latin hypercube covers every stratum once", isTrue, checkSampling(c, lhs, samples, samples, 1));
+    delete lhs;
+
+    // 30 samples in 3D give 3 strata per axis, every stratum of an axis holds 9 points
+    auto strat = c->beginStratified(30, 42);
+    test("Stratified sampling covers every stratum", isTrue, checkSampling(c, strat, 27, 3, 9));
+    delete strat;
+
+    auto it1 = c->beginLatinHypercube(samples, 7), it2 = c->beginLatinHypercube(samples, 7);
+    test("Latin hypercube is reproducible", isTrue, isSameSequence(it1, it2, logger));
+    delete it1;
+    delete it2;
+
+    it1 = c->beginLatinHypercube(samples, 7);
+    it2 = c->beginLatinHypercube(samples, 8);
+    test("Latin hypercube depends on seed", isTrue, !isSameSequence(it1, it2, logger));
+    delete it1;
+    delete it2;
+
+    auto bad = c->beginLatinHypercube(0, 7);
+    test("Sampling without points", isBad<ICompact::iterator>, bad);
+    delete bad;
+
+    // samples * dim wraps around
+    bad = c->beginLatinHypercube(static_cast<size_t>(-1) / DIM + 2, 7);
+    test("Sampling with too many points", isBad<ICompact::iterator>, bad);
+    delete bad;
+}
+
+// saves the state of <it> after <steps> steps and checks that the restored iterator continues the same way
+static bool checkRestore(ICompact* c, ICompact::iterator* it, size_t steps, ILogger* logger) {
+    if (it == nullptr) { return false; }
+
+    for (size_t i = 0; i < steps; ++i) {
+        if (it->doStep() != RESULT_CODE::SUCCESS) { return false; }
+    }
+
+    auto size = it->getStateSize();
+    auto blob = new char[size];
+    if (it->saveState(blob, size) != RESULT_CODE::SUCCESS) {
+        delete[] blob;
+        return false;
+    }
+
+    auto restored = c->restore(blob, size);
+    auto truncated = c->restore(blob, size - 1);
+    delete[] blob;
+
+    bool ok = truncated == nullptr && isSameSequence(it, restored, logger);
+    delete truncated;
+    delete restored;
+    return ok;
+}
+
+static void testCheckpoint(ICompact* c, ILogger* logger) {
+    assert(c);
+
+    array<double, DIM> stepData = {0.25, 0.5, 0.5};
+    auto step = IVector::createVector(DIM, stepData.data(), logger);
+
+    auto grid = c->begin(step);
+    test("Restore grid iterator", isTrue, checkRestore(c, grid, 7, logger));
+    delete grid;
+
+    auto lhs = c->beginLatinHypercube(16, 3);
+    test("Restore sampling iterator", isTrue, checkRestore(c, lhs, 5, logger));
+    delete lhs;
+
+    auto garbage = c->restore(stepData.data(), sizeof(stepData));
+    test("Restore from garbage", isBad<ICompact::iterator>, garbage);
+    delete garbage;
+
+    delete step;
+}
+
+static void testGridSize(ICompact* c, ILogger* logger) {
+    assert(c);
+
+    array<double, DIM> stepData = {0.25, 0.3, 0.5};
+    auto step = IVector::createVector(DIM, stepData.data(), logger);
+
+    size_t perAxis[DIM], total = 0;
+    auto rc = c->gridSize(step, perAxis, total);
+    test("Grid size per axis", isTrue, rc == RESULT_CODE::SUCCESS && perAxis[0] == 5 && perAxis[1] == 5 && perAxis[2] == 3);
+
+    auto it = c->begin(step);
+    test("Grid size equals iterated points", isTrue, total == countPoints(it));
+    delete it;
+
+    double seconds = 0;
+    rc = c->estimateCost(step, 0.5, seconds);
+    test("Grid cost estimation", isTrue, rc == RESULT_CODE::SUCCESS && std::abs(seconds - 37.5) < tolerance);
+    delete step;
+
+    array<double, DIM> bigEnd = {1000, 1000, 1000}, tinyStep = {1e-5, 1e-5, 1e-5};
+    auto big = createCompact<DIM, DIM>(&beginData_1, &bigEnd, logger);
+    step = IVector::createVector(DIM, tinyStep.data(), logger);
+    if (big != nullptr && step != nullptr) {
+        rc = big->gridSize(step, nullptr, total);
+        test("Grid size overflow", isTrue, rc == RESULT_CODE::OUT_OF_BOUNDS);
+
+        rc = big->estimateCost(step, 1e-3, seconds);
+        test("Grid cost of overflowing grid", isTrue, rc == RESULT_CODE::SUCCESS && seconds > 1e20);
+    }
+    delete big;
+    delete step;
+}
+
+// collects the points an iterator visits
+static void collectPoints(ICompact::iterator* it, vector<array<double, DIM>>& points) {
+    if (it == nullptr) { return; }
+
+    do {
+        auto p = it->getPoint();
+        array<double, DIM> coords;
+        for (size_t i = 0; i < DIM; ++i) { coords[i] = p->getCoord(i); }
+        points.push_back(coords);
+        delete p;
+    } while (it->doStep() == RESULT_CODE::SUCCESS);
+}
+
+static void testFaces(ICompact* c, ILogger* logger) {
+    assert(c);
+
+    array<double, DIM> stepData = {0.25, 0.3, 0.5};
+    auto step = IVector::createVector(DIM, stepData.data(), logger);
+    size_t perAxis[DIM], total = 0;
+    c->gridSize(step, perAxis, total);
+
+    test("Number of vertices, edges and facets", isTrue,
+         c->faceCount(0) == 8 && c->faceCount(1) == 12 && c->faceCount(2) == 6 && c->faceCount(DIM + 1) == 0);
+
+    for (size_t faceDim = 0; faceDim < DIM; ++faceDim) {
+        // grid points with at least DIM - faceDim extreme indices
+        size_t expected = 0;
+        for (size_t i = 0; i < perAxis[0]; ++i) {
+            for (size_t j = 0; j < perAxis[1]; ++j) {
+                for (size_t k = 0; k < perAxis[2]; ++k) {
+                    size_t extreme = (i == 0 || i + 1 == perAxis[0]) + (j == 0 || j + 1 == perAxis[1]) + (k == 0 || k + 1 == perAxis[2]);
+                    expected += extreme + faceDim >= DIM;
+                }
+            }
+        }
+
+        vector<array<double, DIM>> points, perFace;
+        auto it = c->beginFaces(step, faceDim);
+        collectPoints(it, points);
+        delete it;
+
+        for (size_t face = 0; face < c->faceCount(faceDim); ++face) {
+            it = c->beginFace(step, faceDim, face);
+            collectPoints(it, perFace);
+            delete it;
+        }
+
+        bool onBoundary = true;
+        for (auto const& p: points) {
+            size_t extreme = 0;
+            for (size_t i = 0; i < DIM; ++i) {
+                extreme += std::abs(p[i] - beginData_1[i]) < tolerance || std::abs(p[i] - endData_1[i]) < tolerance;
+            }
+            onBoundary = onBoundary && extreme + faceDim >= DIM;
+        }
+
+        sort(points.begin(), points.end());
+        sort(perFace.begin(), perFace.end());
+        bool unique = adjacent_find(points.begin(), points.end()) == points.end();
+
+        string name = "Faces of dimension " + to_string(faceDim);
+        test(name + ": every point once", isTrue, points.size() == expected && unique && onBoundary);
+        test(name + ": faces split the points", isTrue, points == perFace);
+    }
+
+    auto bad = c->beginFace(step, 1, c->faceCount(1));
+    test("Face out of range", isBad<ICompact::iterator>, bad);
+    delete bad;
+    bad = c->beginFaces(step, DIM + 1);
+    test("Faces of too large dimension", isBad<ICompact::iterator>, bad);
+    delete bad;
+    delete step;
+}
+
+static void testRange(ICompact* c, ILogger* logger) {
+    assert(c);
+
+    array<double, DIM> stepData = {0.25, 0.3, 0.5};
+    auto step = IVector::createVector(DIM, stepData.data(), logger);
+    size_t total = 0;
+    c->gridSize(step, nullptr, total);
+
+    vector<array<double, DIM>> expected;
+    auto it = c->begin(step);
+    collectPoints(it, expected);
+    delete it;
+
+    vector<array<double, DIM>> points;
+    CompactRange grid(c->begin(step));
+    for (IVector const& point: grid) {
+        array<double, DIM> coords;
+        for (size_t i = 0; i < DIM; ++i) { coords[i] = point.getCoord(i); }
+        points.push_back(coords);
+    }
+    test("Range visits the grid", isTrue, points == expected && points.size() == total && grid.status() == RESULT_CODE::OUT_OF_BOUNDS);
+
+    auto lowerHalf = [](IVector const& point) { return point.getCoord(0) < 0.5; };
+    size_t filtered = 0;
+    for (IVector const& point: filter(CompactRange(c->begin(step)), lowerHalf)) {
+        filtered += lowerHalf(point);
+    }
+    size_t lower = count_if(expected.begin(), expected.end(), [](array<double, DIM> const& p) { return p[0] < 0.5; });
+    test("Filtered range", isTrue, filtered == lower && lower > 0);
+
+    const size_t batchSize = 16;
+    vector<array<double, DIM>> batched;
+    bool fullBatches = true;
+    CompactRange source(c->begin(step));
+    for (PointBatch const& batch: batches(filter(source, lowerHalf), batchSize)) {
+        fullBatches = fullBatches && batch.dim == DIM && batch.count > 0 && batch.count <= batchSize;
+        for (size_t k = 0; k < batch.count; ++k) {
+            batched.push_back({{batch[k][0], batch[k][1], batch[k][2]}});
+        }
+    }
+    vector<array<double, DIM>> lowerPoints;
+    copy_if(expected.begin(), expected.end(), back_inserter(lowerPoints), [](array<double, DIM> const& p) { return p[0] < 0.5; });
+    test("Batches of a filtered range", isTrue, fullBatches && batched == lowerPoints && source.status() == RESULT_CODE::OUT_OF_BOUNDS);
+
+    CompactRange empty(nullptr);
+    test("Range over null iterator", isTrue, empty.begin() == empty.end() && empty.status() == RESULT_CODE::BAD_REFERENCE);
+    delete step;
+}
+
+// reads back a file written by ICompact::exportGrid, point k of the grid is points[k]
+static bool readGrid(char const* path, vector<array<double, DIM>>& points, array<double, 3 * DIM>& described) {
+    FILE *file = fopen(path, "rb");
+    if (file == nullptr) { return false; }
+
+    struct {
+        unsigned int magic, version;
+        unsigned long long dim, points, dataOffset;
+    } header;
+    bool ok = fread(&header, sizeof(header), 1, file) == 1 && header.magic == 0x44524743 && header.dim == DIM
+              && fread(described.data(), sizeof(double), described.size(), file) == described.size()
+              && header.dataOffset % 4096 == 0;
+
+    points.resize(ok ? header.points : 0);
+    vector<double> column(points.size());
+    for (size_t i = 0; ok && i < DIM; ++i) {
+        ok = fseek(file, static_cast<long>(header.dataOffset + i * header.points * sizeof(double)), SEEK_SET) == 0
+             && fread(column.data(), sizeof(double), column.size(), file) == column.size();
+        for (size_t k = 0; ok && k < column.size(); ++k) { points[k][i] = column[k]; }
+    }
+    fclose(file);
+    return ok;
+}
+
+static void testExport(ICompact* c, ILogger* logger) {
+    assert(c);
+
+    const char *path = "compact_tests_grid.bin";
+    array<double, DIM> stepData = {0.25, 0.3, 0.5};
+    auto step = IVector::createVector(DIM, stepData.data(), logger);
+
+    vector<array<double, DIM>> expected;
+    auto it = c->begin(step);
+    collectPoints(it, expected);
+    delete it;
+
+    for (size_t partitions: {1, 4}) {
+        vector<array<double, DIM>> points;
+        array<double, 3 * DIM> described;
+        auto rc = c->exportGrid(step, path, partitions);
+        bool ok = rc == RESULT_CODE::SUCCESS && readGrid(path, points, described) && points.size() == expected.size();
+
+        for (size_t i = 0; ok && i < DIM; ++i) {
+            ok = described[i] == beginData_1[i] && described[DIM + i] == endData_1[i] && described[2 * DIM + i] == stepData[i];
+        }
+        for (size_t k = 0; ok && k < points.size(); ++k) {
+            for (size_t i = 0; i < DIM; ++i) {
+                ok = ok && std::abs(points[k][i] - expected[k][i]) < tolerance;
+            }
+        }
+        test("Export grid in " + to_string(partitions) + " partitions", isTrue, ok);
+        remove(path);
+    }
+
+    test("Export grid to null path", isTrue, c->exportGrid(step, nullptr, 1) == RESULT_CODE::BAD_REFERENCE);
+    delete step;
+}
+
+struct AdaptiveSearch {
+    size_t evaluations;
+    double best;
+    array<double, DIM> bestPoint;
+};
+
+// paraboloid with minimum at (0.3, 0.6, 0.2)
+static RESULT_CODE paraboloid(IVector const* point, double& score, void* pContext) {
+    auto search = static_cast<AdaptiveSearch*>(pContext);
+    array<double, DIM> const minimum = {0.3, 0.6, 0.2};
+
+    score = 0;
+    for (size_t i = 0; i < DIM; ++i) {
+        score += (point->getCoord(i) - minimum[i]) * (point->getCoord(i) - minimum[i]);
+    }
+
+    search->evaluations++;
+    if (score < search->best) {
+        search->best = score;
+        for (size_t i = 0; i < DIM; ++i) { search->bestPoint[i] = point->getCoord(i); }
+    }
+    return RESULT_CODE::SUCCESS;
+}
+
+// the paraboloid where z <= 0.3, undefined elsewhere
+static RESULT_CODE halfParaboloid(IVector const* point, double& score, void* pContext) {
+    auto rc = paraboloid(point, score, pContext);
+    if (point->getCoord(2) > 0.3) { score = NAN; }
+    return rc;
+}
+
+static void testAdaptive(ICompact* c, ILogger* logger) {
+    assert(c);
+
+    const double resolution = 1.0 / 64;
+    array<double, DIM> stepData = {resolution, resolution, resolution};
+    auto step = IVector::createVector(DIM, stepData.data(), logger);
+
+    AdaptiveSearch search = {0, 1e10, {{0, 0, 0}}};
+    auto it = c->beginAdaptive(step, paraboloid, &search, 0.25);
+    if (it != nullptr) {
+        while (it->doStep() == RESULT_CODE::SUCCESS) {}
+    }
+    delete it;
+
+    size_t gridPoints = 0;
+    c->gridSize(step, nullptr, gridPoints);
+
+    bool nearMinimum = std::abs(search.bestPoint[0] - 0.3) <= resolution
+            && std::abs(search.bestPoint[1] - 0.6) <= resolution
+            && std::abs(search.bestPoint[2] - 0.2) <= resolution;
+    test("Adaptive iteration reaches step resolution", isTrue, nearMinimum);
+    test("Adaptive iteration needs fewer points than grid", isTrue, search.evaluations * 100 < gridPoints);
+
+    search = AdaptiveSearch{0, 1e10, {{0, 0, 0}}};
+    it = c->beginAdaptive(step, halfParaboloid, &search, 0.25);
+    if (it != nullptr) {
+        while (it->doStep() == RESULT_CODE::SUCCESS) {}
+    }
+    delete it;
+    nearMinimum = std::abs(search.bestPoint[0] - 0.3) <= resolution
+            && std::abs(search.bestPoint[1] - 0.6) <= resolution
+            && std::abs(search.bestPoint[2] - 0.2) <= resolution;
+    test("Adaptive iteration with NaN scores", isTrue, nearMinimum);
+
+    auto bad = c->beginAdaptive(step, paraboloid, &search, 0);
+    test("Adaptive iteration with zero keep ratio", isBad<ICompact::iterator>, bad);
+    delete bad;
+
+    delete step;
+}
+
 int main() {
     ILogger *logger = ILogger::createLogger(CLIENT(CLIENT_KEY));
 
@@ -314,7 +816,15 @@ int main() {
         test("Check dimension", isTrue, compact1->getDim() == DIM);
         checkBadCreation(nullptr);
         testClone(compact1, logger);
+        testSharedBounds(logger);
         testIsContains(compact1, logger);
+        testSampling(compact1, nullptr);
+        testCheckpoint(compact1, nullptr);
+        testGridSize(compact1, nullptr);
+        testAdaptive(compact1, nullptr);
+        testFaces(compact1, nullptr);
+        testRange(compact1, nullptr);
+        testExport(compact1, nullptr);
 
         auto compact2 = createCompact<DIM, DIM>(&beginData_2, &endData_2, logger);
         if (checkCompact<DIM>(compact2, beginData_2, endData_2, logger)) {
@@ -324,6 +834,7 @@ int main() {
                 testUnify(compact1, compact2, compact3, logger);
                 testIntersect(compact1, compact2, compact3, logger);
                 testConvex(compact1, compact3, logger);
+                testFold(compact1, compact2, compact3, logger);
             }
             delete compact3;
         }
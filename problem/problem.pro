@@ -18,7 +18,8 @@ HEADERS += \
     include/IVector.h \
     include/ICompact.h \
     include/IProblem.h \
-    include/IBrocker.h
+    include/IBrocker.h \
+    include/Interval.h
 
 LIBS += \
     -L$$PWD/libs/ -llogger \
@@ -3,12 +3,17 @@
 
 #include "include/IProblem.h"
 #include "include/IBrocker.h"
+#include "include/Interval.h"
 
 #define DIM 2
 
 namespace {
-    static double func(double x, double y, double a, double b) {
-        return a * (x - 2.0) * (x - 2.0) + b * y * y + 2.0;
+    static double sqr(double v) { return v * v; }
+
+    // the same formula evaluates points (double) and encloses boxes (Interval)
+    template<class T>
+    static T func(T const& x, T const& y, T const& a, T const& b) {
+        return a * sqr(x - T(2.0)) + b * sqr(y) + T(2.0);
     }
 
     class ProblemImpl : public IProblem {
@@ -52,6 +57,38 @@ namespace {
             return RESULT_CODE::SUCCESS;
         }
 
+        RESULT_CODE goalFunctionBounds(ICompact const* compact, double& lo, double& hi) const override {
+            if (!isCompactValid(compact)) { return RESULT_CODE::WRONG_ARGUMENT; }
+
+            if (params == nullptr) {
+                if (logger != nullptr) {
+                    logger->log("in ProblemImpl::goalFunctionBounds: params are not set", RESULT_CODE::BAD_REFERENCE);
+                }
+                return RESULT_CODE::BAD_REFERENCE;
+            }
+
+            auto begin = compact->getBegin(), end = compact->getEnd();
+            if (begin == nullptr || end == nullptr) {
+                delete begin;
+                delete end;
+                if (logger != nullptr) {
+                    logger->log("in ProblemImpl::goalFunctionBounds: bad compact bounds", RESULT_CODE::BAD_REFERENCE);
+                }
+                return RESULT_CODE::BAD_REFERENCE;
+            }
+
+            Interval
+                    x(begin->getCoord(0), end->getCoord(0)),
+                    y(begin->getCoord(1), end->getCoord(1));
+            delete begin;
+            delete end;
+
+            auto bounds = func(x, y, Interval(params->getCoord(0)), Interval(params->getCoord(1)));
+            lo = bounds.lo;
+            hi = bounds.hi;
+            return RESULT_CODE::SUCCESS;
+        }
+
         RESULT_CODE goalFunctionByArgs(IVector const*  args, double& res) const override {
             return goalFunction(args, params, res);
         }
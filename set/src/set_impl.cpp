@@ -1,257 +1,2628 @@
 #include <algorithm>
+#include <atomic>
 #include <memory>
+#include <mutex>
+#include <string>
 #include <new>
 #include <cmath>
+#include <cstring>
+#include <fstream>
 #include <vector>
 
+#if defined(_WIN32)
+#  define NOMINMAX
+#  define WIN32_LEAN_AND_MEAN
+#  include <windows.h>
+#else
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#endif
+
 #include "include/ISet.h"
+#include "include/ICompact.h"
+#include "include/ParallelFor.h"
 
 namespace {
-    class SetImpl: public ISet {
+    // no element
+    static const size_t none = static_cast<size_t>(-1);
+
+    // norm of a - b, computed exactly as IVector::sub followed by IVector::norm
+    static double distance(double const* a, double const* b, size_t dim, IVector::NORM norm) {
+        double result = 0;
+
+        switch (norm) {
+        case IVector::NORM::NORM_1:
+            for (size_t i = 0; i < dim; i++) {
+                result += std::abs(a[i] - b[i]);
+            }
+            break;
+
+        case IVector::NORM::NORM_2:
+            for (size_t i = 0; i < dim; i++) {
+                result += (a[i] - b[i]) * (a[i] - b[i]);
+            }
+            result = std::sqrt(result);
+            break;
+
+        case IVector::NORM::NORM_INF:
+            for (size_t i = 0; i < dim; i++) {
+                result = std::max(result, std::abs(a[i] - b[i]));
+            }
+            break;
+        }
+        return result;
+    }
+
+    // index of the cell <cell> wide that holds <x>, clamped to stay representable
+    static long long cellIndex(double x, double cell) {
+        const double limit = 4e18;
+        return static_cast<long long>(std::max(-limit, std::min(limit, std::floor(x / cell))));
+    }
+
+    // the hash of a cell is built one axis at a time: start, mix in every index, finish
+    static const unsigned long long cellHashStart = 0x9E3779B97F4A7C15ULL;
+
+    static unsigned long long mixCell(unsigned long long h, long long index) {
+        h ^= static_cast<unsigned long long>(index) + 0x9E3779B97F4A7C15ULL + (h << 6) + (h >> 2);
+        return h * 0xBF58476D1CE4E5B9ULL;
+    }
+
+    static unsigned long long finishCell(unsigned long long h) { return h ^ (h >> 31); }
+
+    static unsigned long long hashCell(long long const* at, size_t dim) {
+        unsigned long long h = cellHashStart;
+        for (size_t i = 0; i < dim; i++) { h = mixCell(h, at[i]); }
+        return finishCell(h);
+    }
+
+    // hashCell of the cell <cell> wide that holds <point>, without storing its indices
+    static unsigned long long hashPointCell(double const* point, size_t dim, double cell) {
+        unsigned long long h = cellHashStart;
+        for (size_t i = 0; i < dim; i++) { h = mixCell(h, cellIndex(point[i], cell)); }
+        return finishCell(h);
+    }
+
+    static bool inside(double const* point, double const* lo, double const* hi, size_t dim) {
+        for (size_t i = 0; i < dim; i++) {
+            if (point[i] < lo[i] || point[i] > hi[i]) { return false; }
+        }
+        return true;
+    }
+
+    // (distance, id) of a neighbour candidate, closer first and equally close ones by id
+    typedef std::pair<double, size_t> Neighbour;
+
+    // keeps in the max-heap <best> the <k> smallest candidates offered to it
+    static void offer(std::vector<Neighbour>& best, size_t k, Neighbour candidate) {
+        if (best.size() < k) {
+            best.push_back(candidate);
+            std::push_heap(best.begin(), best.end());
+        } else if (candidate < best.front()) {
+            std::pop_heap(best.begin(), best.end());
+            best.back() = candidate;
+            std::push_heap(best.begin(), best.end());
+        }
+    }
+
+    // read-only mapping of a whole file, its pages are read on first access
+    class MappedFile {
+    public:
+        // nullptr if the file cannot be mapped
+        static std::shared_ptr<MappedFile const> open(char const* path) {
+            MappedFile *file = new (std::nothrow) MappedFile();
+            if (file == nullptr) { return nullptr; }
+            if (!file->map(path)) {
+                delete file;
+                return nullptr;
+            }
+            return std::shared_ptr<MappedFile const>(file);
+        }
+
+        ~MappedFile() {
+#if defined(_WIN32)
+            if (begin != nullptr) { UnmapViewOfFile(begin); }
+            if (mapping != nullptr) { CloseHandle(mapping); }
+            if (file != INVALID_HANDLE_VALUE) { CloseHandle(file); }
+#else
+            if (begin != nullptr) { munmap(const_cast<char*>(begin), length); }
+#endif
+        }
+
+        char const* data() const { return begin; }
+        size_t size() const { return length; }
+
     private:
-        std::vector<IVector const*> elements;
-        ILogger* pLogger;
+        char const* begin = nullptr;
+        size_t length = 0;
+#if defined(_WIN32)
+        HANDLE file = INVALID_HANDLE_VALUE, mapping = nullptr;
+#endif
+
+        MappedFile() = default;
+        MappedFile(MappedFile const& file) = delete;
+        MappedFile& operator=(MappedFile const& file) = delete;
+
+        bool map(char const* path) {
+#if defined(_WIN32)
+            file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+            LARGE_INTEGER size;
+            if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &size) || size.QuadPart <= 0) { return false; }
+
+            mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (mapping == nullptr) { return false; }
+            begin = static_cast<char const*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+            length = static_cast<size_t>(size.QuadPart);
+            return begin != nullptr;
+#else
+            int fd = ::open(path, O_RDONLY);
+            if (fd < 0) { return false; }
+
+            struct stat info;
+            void *at = MAP_FAILED;
+            if (fstat(fd, &info) == 0 && info.st_size > 0) {
+                at = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            }
+            // the mapping keeps the file alive
+            close(fd);
+            if (at == MAP_FAILED) { return false; }
+
+            begin = static_cast<char const*>(at);
+            length = static_cast<size_t>(info.st_size);
+            return true;
+#endif
+        }
+    };
 
-        SetImpl(SetImpl const& set) = delete;
-        SetImpl& operator=(SetImpl const& set) = delete;
+    // items owned in a vector or viewed in a mapped file, copies of a view share the file;
+    // the viewed items are copied before the first change
+    template<class T>
+    class Buffer {
+    public:
+        size_t size() const { return view != nullptr ? viewSize : items.size(); }
+        bool empty() const { return size() == 0; }
+
+        T const* data() const { return view != nullptr ? view : items.data(); }
+        T const& operator[](size_t k) const { return data()[k]; }
+
+        // the items to change
+        std::vector<T>& own() {
+            if (view != nullptr) {
+                items.assign(view, view + viewSize);
+                view = nullptr;
+                file.reset();
+            }
+            return items;
+        }
+
+        void clear() {
+            items.clear();
+            view = nullptr;
+            file.reset();
+        }
+
+        void map(std::shared_ptr<MappedFile const> const& file, T const* at, size_t count) {
+            items.clear();
+            this->file = file;
+            view = at;
+            viewSize = count;
+        }
+
+    private:
+        std::vector<T> items;
+        T const* view = nullptr;
+        size_t viewSize = 0;
+        std::shared_ptr<MappedFile const> file;
+    };
+
+    /* layout of ISet::save: the header, then sections of a uint64 count followed by that many items
+       from the next multiple of <alignment>; the storage goes first, then what the index writes */
+    struct SetFileHeader {
+        enum Kind : unsigned int {
+            KD_INDEX = 1,
+            GRID_INDEX = 2
+        };
+        static const unsigned int signature = 0x54455349; // "ISET"
+        static const unsigned int currentVersion = 3;
+        static const size_t alignment = 64;
+
+        unsigned int magic;
+        unsigned int version;
+        // sizeof(size_t) of the writer, ids are stored as they are
+        unsigned int wordSize;
+        unsigned int kind;
+        unsigned long long dim;
+        unsigned long long count;
+        // grid cell width, 0 for the k-d index
+        double cell;
+    };
 
+    class FileWriter {
     public:
-        SetImpl(ILogger* pLogger) : pLogger(pLogger) {}
+        explicit FileWriter(char const* path): file(path, std::ios::out | std::ios::binary | std::ios::trunc) {}
 
-        ~SetImpl() override { clear(); }
+        void write(void const* data, size_t bytes) {
+            file.write(static_cast<char const*>(data), static_cast<std::streamsize>(bytes));
+            offset += bytes;
+        }
 
-        RESULT_CODE insert(const IVector* pVector,IVector::NORM norm, double tolerance) override {
-            if (std::isnan(tolerance) || tolerance < 0) {
+        void value(unsigned long long value) { write(&value, sizeof(value)); }
+
+        // the count of a section and the padding before its items, which are written next
+        void section(size_t count) {
+            value(count);
+            static const char zeros[SetFileHeader::alignment] = {};
+            write(zeros, (SetFileHeader::alignment - offset % SetFileHeader::alignment) % SetFileHeader::alignment);
+        }
+
+        template<class T>
+        void items(Buffer<T> const& buffer) {
+            section(buffer.size());
+            write(buffer.data(), buffer.size() * sizeof(T));
+        }
+
+        // false if anything failed
+        bool close() {
+            file.close();
+            return !file.fail();
+        }
+
+    private:
+        std::ofstream file;
+        size_t offset = 0;
+    };
+
+    // reads back what FileWriter wrote, items are mapped and not copied; false past the end of the file
+    class FileReader {
+    public:
+        explicit FileReader(std::shared_ptr<MappedFile const> const& file): file(file) {}
+
+        std::shared_ptr<MappedFile const> const& getFile() const { return file; }
+
+        bool read(void* data, size_t bytes) {
+            if (bytes > file->size() - offset) { return false; }
+            memcpy(data, file->data() + offset, bytes);
+            offset += bytes;
+            return true;
+        }
+
+        bool value(unsigned long long& value) { return read(&value, sizeof(value)); }
+
+        // the mapped items of the next section, nullptr if it does not fit into the file
+        template<class T>
+        T const* section(size_t& count) {
+            unsigned long long items;
+            if (!value(items)) { return nullptr; }
+            offset += (SetFileHeader::alignment - offset % SetFileHeader::alignment) % SetFileHeader::alignment;
+            if (offset > file->size() || items > (file->size() - offset) / sizeof(T)) { return nullptr; }
+
+            auto at = reinterpret_cast<T const*>(file->data() + offset);
+            count = static_cast<size_t>(items);
+            offset += count * sizeof(T);
+            return at;
+        }
+
+        template<class T>
+        bool items(Buffer<T>& buffer) {
+            size_t count;
+            T const* at = section<T>(count);
+            if (at != nullptr) { buffer.map(file, at, count); }
+            return at != nullptr;
+        }
+
+    private:
+        std::shared_ptr<MappedFile const> file;
+        size_t offset = 0;
+    };
+
+    /* units of <width> items in pages of 2^shift units: copies share the pages and a shared page is copied
+       before it changes, so a copy costs a pointer per page and a change of it copies only the pages it touches.
+       Pages may view a mapped file as Buffer does */
+    template<class T>
+    class Pages {
+    public:
+        Pages(size_t shift, size_t width): shift(shift), width(width) {}
+
+        size_t size() const { return count; }
+
+        // unit <k>, the units after it up to the end of its page follow it
+        T const* at(size_t k) const { return bases[k >> shift] + (k & mask()) * width; }
+        T const& operator[](size_t k) const { return *at(k); }
+
+        // units [k, k + run(k)) lie one after another
+        size_t run(size_t k) const { return std::min(count - k, (mask() - (k & mask())) + 1); }
+
+        // unit <k> to change, its page is copied first if it is shared or mapped
+        T* change(size_t k) { return own(k >> shift).data() + (k & mask()) * width; }
+
+        // appends <n> units stored one after another
+        void append(T const* units, size_t n) {
+            while (n > 0) {
+                if ((count & mask()) == 0) {
+                    pages.push_back(std::make_shared<Buffer<T>>());
+                    bases.push_back(nullptr);
+                }
+                auto &items = own(pages.size() - 1);
+                size_t added = std::min(n, mask() + 1 - (count & mask()));
+                items.insert(items.end(), units, units + added * width);
+                count += added;
+                units += added * width;
+                n -= added;
+            }
+        }
+
+        // keeps the first <n> units
+        void truncate(size_t n) {
+            if (n >= count) { return; }
+            count = n;
+            size_t used = (n + mask()) >> shift;
+            pages.resize(used);
+            bases.resize(used);
+            if ((n & mask()) != 0) { own(used - 1).resize((n & mask()) * width); }
+        }
+
+        // erases the units of <ids>, given in increasing order, in one pass; the pages before the first one stay shared
+        void erase(std::vector<size_t> const& ids) {
+            size_t kept = ids.empty() ? count : ids.front(), next = 0;
+            for (size_t k = kept; k < count; k++) {
+                if (next < ids.size() && ids[next] == k) {
+                    next++;
+                    continue;
+                }
+                T* to = change(kept);
+                std::copy(at(k), at(k) + width, to);
+                kept++;
+            }
+            truncate(kept);
+        }
+
+        // <n> units of <width> copies of <value>
+        void assign(size_t n, T const& value) {
+            clear();
+            std::vector<T> page(std::min(n, mask() + 1) * width, value);
+            while (count < n) { append(page.data(), std::min(n - count, mask() + 1)); }
+        }
+
+        void clear() {
+            pages.clear();
+            bases.clear();
+            count = 0;
+        }
+
+        // one section of all the items, as if they were in one buffer
+        void save(FileWriter& file) const {
+            file.section(count * width);
+            for (size_t p = 0; p < pages.size(); p++) { file.write(bases[p], pages[p]->size() * sizeof(T)); }
+        }
+
+        bool load(FileReader& file) {
+            clear();
+            size_t items;
+            T const* from = file.section<T>(items);
+            if (from == nullptr || (width != 0 ? items % width != 0 : items != 0)) { return false; }
+
+            size_t units = width != 0 ? items / width : 0, perPage = mask() + 1;
+            for (size_t first = 0; first < units; first += perPage) {
+                auto page = std::make_shared<Buffer<T>>();
+                page->map(file.getFile(), from + first * width, std::min(perPage, units - first) * width);
+                pages.push_back(page);
+                bases.push_back(page->data());
+            }
+            count = units;
+            return true;
+        }
+
+    private:
+        size_t shift, width, count = 0;
+        std::vector<std::shared_ptr<Buffer<T>>> pages;
+        // data of every page
+        std::vector<T const*> bases;
+
+        size_t mask() const { return (static_cast<size_t>(1) << shift) - 1; }
+
+        // the items of page <p> to change, with room for a whole page
+        std::vector<T>& own(size_t p) {
+            if (pages[p].use_count() > 1) { pages[p] = std::make_shared<Buffer<T>>(*pages[p]); }
+            auto &items = pages[p]->own();
+            items.reserve((mask() + 1) * width);
+            bases[p] = items.data();
+            return items;
+        }
+    };
+
+    // coordinates of all elements in pages of 1024 elements, element k at point(k)[0 .. dim)
+    class Storage {
+    public:
+        void reset(size_t dim) {
+            this->dim = dim;
+            coords = Pages<double>(pageShift, dim);
+        }
+
+        size_t getDim() const { return dim; }
+        size_t getSize() const { return coords.size(); }
+
+        double const* point(size_t k) const { return coords.at(k); }
+
+        // elements [k, k + run(k)) lie one after another from point(k)
+        size_t run(size_t k) const { return coords.run(k); }
+
+        void push(double const* point) { coords.append(point, 1); }
+
+        // appends <count> points stored one after another
+        void append(double const* points, size_t count) { coords.append(points, count); }
+
+        // erases the points of <ids>, given in increasing order, in one pass
+        void erase(std::vector<size_t> const& ids) { coords.erase(ids); }
+
+        // moves the last point into <k> and drops the last
+        void swapErase(size_t k) {
+            size_t last = getSize() - 1;
+            if (k != last) {
+                double *to = coords.change(k);
+                std::copy(point(last), point(last) + dim, to);
+            }
+            coords.truncate(last);
+        }
+
+        void save(FileWriter& file) const { coords.save(file); }
+
+        bool load(FileReader& file, size_t dim) {
+            reset(dim);
+            return coords.load(file);
+        }
+
+    private:
+        static const size_t pageShift = 10;
+
+        size_t dim = 0;
+        Pages<double> coords{pageShift, 0};
+    };
+
+    /* spatial index of the element coordinates by element index: a forest of static k-d trees
+       (the logarithmic method), a tree absorbs the smaller trees after it when a point is added,
+       so an insert costs O(log^2 n) amortized and a box query visits O(log^2 n) nodes plus the answer.
+       The trees hold ids and split axes only, the coordinates are read from the set storage.
+       The node of an erased point takes the live point below it closest along its axis,
+       a node with no live point below it stays as a tombstone until they outnumber the live ones */
+    class KdIndex {
+    public:
+        void reset(size_t dim) {
+            this->dim = dim;
+            trees.clear();
+            alive = dead = 0;
+        }
+
+        size_t getSize() const { return alive; }
+
+        // adds the points [firstId, firstId + count) of <elements>
+        void insert(Storage const& elements, size_t firstId, size_t count) {
+            if (count == 0) { return; }
+            std::vector<size_t> added(count);
+            for (size_t k = 0; k < count; k++) { added[k] = firstId + k; }
+
+            // merge while the last tree is not larger than the points that come into it
+            while (!trees.empty() && trees.back()->alive <= added.size()) {
+                collect(*trees.back(), added);
+                dead -= trees.back()->ids.size() - trees.back()->alive;
+                trees.pop_back();
+            }
+            trees.push_back(std::make_shared<Tree>(build(elements, added)));
+            alive += count;
+        }
+
+        // drops the ids of <ids>, given in increasing order, and shifts the greater ids down past them, as erasing
+        // from a vector does; the points of <ids> are still in <elements>.
+        // Only the pages of ids that change are copied, the rest stay shared with the copies of the index
+        void eraseShift(Storage const& elements, std::vector<size_t> const& ids) {
+            if (ids.empty()) { return; }
+            for (auto id: ids) { rename(elements, id, elements.point(id), none); }
+            // a rebuild reads the points by their ids before the shift
+            compact(elements);
+
+            for (auto &shared: trees) {
+                for (size_t k = 0; k < shared->ids.size(); k++) {
+                    size_t treeId = shared->ids[k];
+                    if (treeId == none || treeId <= ids.front()) { continue; }
+                    if (shared.use_count() > 1) { shared = std::make_shared<Tree>(*shared); }
+                    *shared->ids.change(k) = treeId - (std::lower_bound(ids.begin(), ids.end(), treeId) - ids.begin());
+                }
+            }
+        }
+
+        // drops <id> and gives its id to <last>, the greatest one, as moving the last point into its place does;
+        // both are found by descending to their points, O(log^2 n), and only the trees that hold them change
+        void swapErase(Storage const& elements, size_t id, double const* point, size_t last, double const* lastPoint) {
+            rename(elements, id, point, none);
+            // a rebuild reads the points by their ids before the move
+            compact(elements);
+            if (id != last) { rename(elements, last, lastPoint, id); }
+        }
+
+        // visit(id, coords) for every point of the box [lo, hi]
+        template<class Visit>
+        void query(Storage const& elements, double const* lo, double const* hi, Visit&& visit) const {
+            for (auto const& tree: trees) {
+                query(elements, *tree, 0, tree->ids.size(), lo, hi, visit);
+            }
+        }
+
+        // the <k> points closest to <point>, closest first
+        void nearest(Storage const& elements, double const* point, size_t k, IVector::NORM norm, std::vector<Neighbour>& best) const {
+            best.clear();
+            if (k == 0) { return; }
+            for (auto const& tree: trees) {
+                nearest(elements, *tree, 0, tree->ids.size(), point, k, norm, best);
+            }
+            std::sort_heap(best.begin(), best.end());
+        }
+
+        static const unsigned int fileKind = SetFileHeader::KD_INDEX;
+        double getCell() const { return 0; }
+
+        // the trees as they are, tombstones included
+        void save(FileWriter& file) const {
+            file.value(trees.size());
+            for (auto const& tree: trees) {
+                file.value(tree->alive);
+                tree->ids.save(file);
+                file.items(*tree->axes);
+            }
+        }
+
+        // the ids of the live points are 0, 1, ... as many as there are
+        bool load(FileReader& file, size_t dim) {
+            reset(dim);
+            unsigned long long count, treeAlive;
+            if (!file.value(count)) { return false; }
+            for (unsigned long long n = 0; n < count; n++) {
+                Tree tree;
+                auto axes = std::make_shared<Buffer<size_t>>();
+                if (!file.value(treeAlive) || !tree.ids.load(file) || !file.items(*axes) || treeAlive > tree.ids.size()
+                    || axes->size() != tree.ids.size()) {
+                    return false;
+                }
+                tree.axes = axes;
+                size_t live = 0;
+                for (size_t k = 0; k < tree.ids.size(); k++) {
+                    if ((*axes)[k] >= dim && tree.ids[k] != none) { return false; }
+                    live += tree.ids[k] != none;
+                }
+                if (live != treeAlive) { return false; }
+                tree.alive = live;
+                alive += live;
+                dead += tree.ids.size() - live;
+                trees.push_back(std::make_shared<Tree>(std::move(tree)));
+            }
+            for (auto const& tree: trees) {
+                for (size_t k = 0; k < tree->ids.size(); k++) {
+                    if (tree->ids[k] != none && tree->ids[k] >= alive) { return false; }
+                }
+            }
+            return true;
+        }
+
+    private:
+        static const size_t idPageShift = 10;
+
+        struct Tree {
+            // implicit tree: node of [from, to) is at (from + to) / 2, splits along axis(node) at the coordinate of its point
+            Pages<size_t> ids{idPageShift, 1};
+            // fixed when the tree is built
+            std::shared_ptr<Buffer<size_t> const> axes;
+            size_t alive = 0;
+
+            size_t axis(size_t node) const { return (*axes)[node]; }
+        };
+
+        size_t dim = 0, alive = 0, dead = 0;
+        // built trees do not change but for the ids of erased points and those given by swapErase,
+        // so copies of the index share them and a tree that changes copies its pages of ids that do
+        std::vector<std::shared_ptr<Tree>> trees;
+
+        // appends the live ids of <from> to <to>
+        static void collect(Tree const& from, std::vector<size_t>& to) {
+            for (size_t k = 0; k < from.ids.size(); k++) {
+                if (from.ids[k] != none) { to.push_back(from.ids[k]); }
+            }
+        }
+
+        // a tree of the points of <ids> in <elements>, <ids> are taken
+        Tree build(Storage const& elements, std::vector<size_t>& ids) const {
+            std::vector<size_t> axes(ids.size());
+            split(elements, ids, axes, 0, ids.size());
+
+            Tree built;
+            built.alive = ids.size();
+            built.ids.append(ids.data(), ids.size());
+            auto shared = std::make_shared<Buffer<size_t>>();
+            shared->own().swap(axes);
+            built.axes = shared;
+            return built;
+        }
+
+        // median split of ids[from, to) along the axis of the largest spread
+        void split(Storage const& elements, std::vector<size_t>& ids, std::vector<size_t>& axes, size_t from, size_t to) const {
+            while (to - from > 1) {
+                size_t axis = 0;
+                double widest = -1;
+                for (size_t i = 0; i < dim; i++) {
+                    double lo = elements.point(ids[from])[i], hi = lo;
+                    for (size_t k = from + 1; k < to; k++) {
+                        lo = std::min(lo, elements.point(ids[k])[i]);
+                        hi = std::max(hi, elements.point(ids[k])[i]);
+                    }
+                    if (hi - lo > widest) {
+                        widest = hi - lo;
+                        axis = i;
+                    }
+                }
+
+                size_t mid = (from + to) / 2;
+                std::nth_element(ids.begin() + from, ids.begin() + mid, ids.begin() + to,
+                                 [&](size_t l, size_t r) { return elements.point(l)[axis] < elements.point(r)[axis]; });
+                axes[mid] = axis;
+
+                split(elements, ids, axes, from, mid);
+                from = mid + 1;
+            }
+        }
+
+        template<class Visit>
+        void query(Storage const& elements, Tree const& tree, size_t from, size_t to, double const* lo, double const* hi,
+                   Visit& visit) const {
+            while (from < to) {
+                size_t mid = (from + to) / 2, id = tree.ids[mid], axis = tree.axis(mid);
+                // nothing is alive below a tombstone
+                if (id == none) { return; }
+
+                double const* point = elements.point(id);
+                bool inside = true;
+                for (size_t i = 0; i < dim && inside; i++) {
+                    inside = lo[i] <= point[i] && point[i] <= hi[i];
+                }
+                if (inside) { visit(id, point); }
+
+                bool left = lo[axis] <= point[axis], right = hi[axis] >= point[axis];
+                if (left && right) {
+                    query(elements, tree, from, mid, lo, hi, visit);
+                    from = mid + 1;
+                } else if (left) {
+                    to = mid;
+                } else {
+                    from = mid + 1;
+                }
+            }
+        }
+
+        // the position of <id> at <point> in [from, to) of <tree>, none if it is not there;
+        // points equal to a node along its axis may lie on either side of it
+        size_t locate(Storage const& elements, Tree const& tree, size_t from, size_t to, double const* point, size_t id) const {
+            while (from < to) {
+                size_t mid = (from + to) / 2, axis = tree.axis(mid);
+                if (tree.ids[mid] == none) { return none; }
+                if (tree.ids[mid] == id) { return mid; }
+
+                double split = elements.point(tree.ids[mid])[axis];
+                if (point[axis] == split) {
+                    size_t found = locate(elements, tree, from, mid, point, id);
+                    if (found != none) { return found; }
+                    from = mid + 1;
+                } else if (point[axis] < split) {
+                    to = mid;
+                } else {
+                    from = mid + 1;
+                }
+            }
+            return none;
+        }
+
+        // replaces <id> at <point> by <to>, erases it if <to> is none
+        void rename(Storage const& elements, size_t id, double const* point, size_t to) {
+            for (auto &shared: trees) {
+                size_t at = locate(elements, *shared, 0, shared->ids.size(), point, id);
+                if (at == none) { continue; }
+
+                if (shared.use_count() > 1) { shared = std::make_shared<Tree>(*shared); }
+                Tree &tree = *shared;
+                if (to != none) {
+                    *tree.ids.change(at) = to;
+                    return;
+                }
+                remove(elements, tree, at);
+                tree.alive--;
+                alive--;
+                dead++;
+                return;
+            }
+        }
+
+        /* takes the point out of node <at>: the live point below it closest to it along its axis, from the side beyond it
+           if there is one there, takes its place and leaves its own node the same way. The node splits its subtree
+           as before and the last node left is a tombstone with nothing alive below it */
+        void remove(Storage const& elements, Tree& tree, size_t at) const {
+            auto &ids = tree.ids;
+            while (true) {
+                size_t from = 0, to = ids.size();
+                for (size_t mid = (from + to) / 2; mid != at; mid = (from + to) / 2) {
+                    if (at < mid) {
+                        to = mid;
+                    } else {
+                        from = mid + 1;
+                    }
+                }
+
+                size_t axis = tree.axis(at), found = none;
+                extreme(elements, tree, at + 1, to, axis, true, found);
+                if (found == none) { extreme(elements, tree, from, at, axis, false, found); }
+                if (found == none) {
+                    *ids.change(at) = none;
+                    return;
+                }
+                *ids.change(at) = ids[found];
+                at = found;
+            }
+        }
+
+        // into <found> the node of the live point of [from, to) of <tree> lowest (or highest) along <axis>,
+        // unless the one there already is
+        void extreme(Storage const& elements, Tree const& tree, size_t from, size_t to, size_t axis, bool lowest,
+                     size_t& found) const {
+            while (from < to) {
+                size_t mid = (from + to) / 2, id = tree.ids[mid];
+                if (id == none) { return; }
+
+                double value = elements.point(id)[axis];
+                if (found == none || (lowest ? value < elements.point(tree.ids[found])[axis] : value > elements.point(tree.ids[found])[axis])) {
+                    found = mid;
+                }
+                // along its own axis a node bounds one side of its subtree
+                if (tree.axis(mid) != axis) {
+                    extreme(elements, tree, from, mid, axis, lowest, found);
+                    from = mid + 1;
+                } else if (lowest) {
+                    to = mid;
+                } else {
+                    from = mid + 1;
+                }
+            }
+        }
+
+        // branch and bound: every norm is at least the difference along the split axis,
+        // so the far side is skipped once that difference exceeds the k-th best distance
+        void nearest(Storage const& elements, Tree const& tree, size_t from, size_t to, double const* point, size_t k,
+                     IVector::NORM norm, std::vector<Neighbour>& best) const {
+            while (from < to) {
+                size_t mid = (from + to) / 2, id = tree.ids[mid], axis = tree.axis(mid);
+                if (id == none) { return; }
+
+                double const* node = elements.point(id);
+                offer(best, k, Neighbour(distance(point, node, dim, norm), id));
+
+                double diff = point[axis] - node[axis];
+                if (diff < 0) {
+                    nearest(elements, tree, from, mid, point, k, norm, best);
+                    from = mid + 1;
+                } else {
+                    nearest(elements, tree, mid + 1, to, point, k, norm, best);
+                    to = mid;
+                }
+                if (best.size() == k && std::abs(diff) > best.front().first) { break; }
+            }
+        }
+
+        // drops the trees with nothing alive and rebuilds everything into one tree once the tombstones outnumber the live points
+        void compact(Storage const& elements) {
+            for (auto const& tree: trees) {
+                if (tree->alive == 0) { dead -= tree->ids.size(); }
+            }
+            trees.erase(std::remove_if(trees.begin(), trees.end(), [](std::shared_ptr<Tree> const& t) { return t->alive == 0; }),
+                        trees.end());
+            if (dead <= alive) { return; }
+
+            std::vector<size_t> all;
+            for (auto const& tree: trees) { collect(*tree, all); }
+            trees.clear();
+            dead = 0;
+            if (!all.empty()) { trees.push_back(std::make_shared<Tree>(build(elements, all))); }
+        }
+    };
+
+    /* blocked Bloom filter of cell hashes: a hash sets 4 bits of one 64-bit word, so a lookup reads one word;
+       about 1% false positives at the 8 to 16 bits per cell GridIndex gives it. Hashes cannot be removed */
+    class CellFilter {
+    public:
+        // <words> is a power of two
+        void reset(size_t words) { bits.assign(words, 0); }
+
+        void clear() { bits.clear(); }
+
+        void add(unsigned long long hash) { *bits.change(word(hash)) |= mask(hash); }
+
+        // false only for a hash that was never added
+        bool mayContain(unsigned long long hash) const {
+            return bits.size() == 0 || (bits[word(hash)] & mask(hash)) == mask(hash);
+        }
+
+        void save(FileWriter& file) const { bits.save(file); }
+
+        bool load(FileReader& file) { return bits.load(file) && (bits.size() & (bits.size() - 1)) == 0; }
+
+    private:
+        Pages<unsigned long long> bits{12, 1};
+
+        // the low bits of a hash pick its slot in GridIndex, the word comes from the high ones
+        size_t word(unsigned long long hash) const { return static_cast<size_t>(hash >> 32) & (bits.size() - 1); }
+
+        static unsigned long long mask(unsigned long long hash) {
+            unsigned long long mixed = hash * 0x9E3779B97F4A7C15ULL, result = 0;
+            for (int k = 0; k < 4; k++) { result |= 1ULL << ((mixed >> (58 - 6 * k)) & 63); }
+            return result;
+        }
+    };
+
+    /* uniform grid of cells <cell> wide hashed by their integer coordinates, each cell keeps a list of its ids
+       and the coordinates are read from the set storage,
+       so a box no wider than a cell touches at most 2^dim cells: O(1) expected insert and lookup.
+       Boxes covering more cells than there are occupied ones are answered by a scan of all points.
+       The heads of the lists are in an open addressing table, so the whole index is two paged arrays.
+       A Bloom filter of the occupied cells turns away most lookups of empty cells before they reach the table */
+    class GridIndex {
+    public:
+        explicit GridIndex(double cell): cell(cell) {}
+
+        void reset(size_t dim) {
+            this->dim = dim;
+            table.clear();
+            occupied = stale = 0;
+            next.clear();
+            filter.clear();
+        }
+
+        size_t getSize() const { return next.size(); }
+
+        // adds the points [firstId, firstId + count) of <elements>;
+        // ids come in increasing order, as elements are appended
+        void insert(Storage const& elements, size_t firstId, size_t count) {
+            reserve(occupied + count);
+            for (size_t k = 0; k < count; k++) {
+                auto cellKey = key(elements.point(firstId + k));
+                Slot &slot = *table.change(find(cellKey));
+                if (slot.head == none) {
+                    slot.hash = cellKey;
+                    occupied++;
+                    filter.add(cellKey);
+                }
+                next.append(&slot.head, 1);
+                slot.head = firstId + k;
+            }
+        }
+
+        // drops the ids of <ids>, given in increasing order, and shifts the greater ids down past them, as erasing
+        // from a vector does; the points of <ids> are still in <elements>
+        void eraseShift(Storage const& elements, std::vector<size_t> const& ids) {
+            if (ids.empty()) { return; }
+            for (auto id: ids) { unlink(id, elements.point(id)); }
+            next.erase(ids);
+
+            // no list holds an erased id any more
+            auto shifted = [&](size_t id) { return id - (std::lower_bound(ids.begin(), ids.end(), id) - ids.begin()); };
+            for (size_t k = 0; k < next.size(); k++) {
+                if (next[k] != none && next[k] > ids.front()) { *next.change(k) = shifted(next[k]); }
+            }
+            for (size_t k = 0; k < table.size(); k++) {
+                if (table[k].head != none && table[k].head > ids.front()) { table.change(k)->head = shifted(table[k].head); }
+            }
+        }
+
+        // drops <id> and gives its id to <last>, the greatest one, as moving the last point into its place does:
+        // O(1) expected, two lists change
+        void swapErase(Storage const&, size_t id, double const* point, size_t last, double const* lastPoint) {
+            unlink(id, point);
+            if (id != last) {
+                size_t at = find(key(lastPoint));
+                if (table[at].head == last) {
+                    table.change(at)->head = id;
+                } else {
+                    size_t k = table[at].head;
+                    while (next[k] != last) { k = next[k]; }
+                    *next.change(k) = id;
+                }
+                *next.change(id) = next[last];
+            }
+            next.truncate(last);
+        }
+
+        // visit(id, coords) for every point of the box [lo, hi]
+        template<class Visit>
+        void query(Storage const& elements, double const* lo, double const* hi, Visit&& visit) const {
+            // reused by every query of the thread, lookups allocate nothing
+            static thread_local std::vector<long long> cellBox;
+            cellBox.resize(3 * dim);
+            long long *from = cellBox.data(), *to = from + dim, *at = to + dim;
+            double cells = 1;
+            for (size_t i = 0; i < dim; i++) {
+                from[i] = cellOf(lo[i]);
+                to[i] = cellOf(hi[i]);
+                cells *= static_cast<double>(to[i] - from[i] + 1);
+            }
+
+            if (cells > static_cast<double>(occupied)) {
+                for (size_t id = 0; id < next.size(); id++) {
+                    if (inside(elements.point(id), lo, hi, dim)) { visit(id, elements.point(id)); }
+                }
+                return;
+            }
+
+            // odometer over the cells of the box, a list may hold points of colliding cells, they are filtered out
+            std::copy(from, from + dim, at);
+            while (true) {
+                auto cellHash = hash(at);
+                for (size_t id = filter.mayContain(cellHash) ? table[find(cellHash)].head : none; id != none; id = next[id]) {
+                    double const* point = elements.point(id);
+                    if (inside(point, lo, hi, dim) && isInCell(point, at)) { visit(id, point); }
+                }
+
+                size_t i = 0;
+                while (i < dim && at[i] == to[i]) {
+                    at[i] = from[i];
+                    i++;
+                }
+                if (i == dim) { break; }
+                at[i]++;
+            }
+        }
+
+        // the <k> points closest to <point>, closest first: boxes around it grow twice at a time
+        // until they hold k points no farther than their half width, or all the points
+        void nearest(Storage const& elements, double const* point, size_t k, IVector::NORM norm, std::vector<Neighbour>& best) const {
+            best.clear();
+            if (k == 0) { return; }
+
+            std::vector<double> box(2 * dim);
+            double *lo = box.data(), *hi = lo + dim;
+            std::vector<Neighbour> found;
+            for (double radius = cell / 2; ; radius *= 2) {
+                for (size_t i = 0; i < dim; i++) {
+                    lo[i] = point[i] - radius;
+                    hi[i] = point[i] + radius;
+                }
+
+                found.clear();
+                size_t within = 0;
+                query(elements, lo, hi, [&](size_t id, double const* coords) {
+                    found.push_back(Neighbour(distance(point, coords, dim, norm), id));
+                    within += found.back().first <= radius;
+                });
+
+                // a point outside the box is farther than radius in every norm
+                if (within >= k || found.size() == getSize() || std::isinf(radius)) { break; }
+            }
+
+            for (auto const& candidate: found) { offer(best, k, candidate); }
+            std::sort_heap(best.begin(), best.end());
+        }
+
+        static const unsigned int fileKind = SetFileHeader::GRID_INDEX;
+        double getCell() const { return cell; }
+
+        void save(FileWriter& file) const {
+            file.value(occupied);
+            table.save(file);
+            next.save(file);
+            filter.save(file);
+        }
+
+        bool load(FileReader& file, size_t dim) {
+            reset(dim);
+            unsigned long long cells;
+            if (!file.value(cells) || !table.load(file) || !next.load(file) || !filter.load(file)) { return false; }
+            occupied = static_cast<size_t>(cells);
+            // a power of two at most half full
+            return (table.size() & (table.size() - 1)) == 0 && 2 * cells <= table.size();
+        }
+
+    private:
+        // hash of an occupied cell and the first id of its list, head == none for a free slot
+        struct Slot {
+            unsigned long long hash;
+            size_t head;
+        };
+
+        double cell;
+        size_t dim = 0, occupied = 0;
+        // linear probing, the size is a power of two and at least twice the occupied slots
+        Pages<Slot> table{12, 1};
+        // next id of the same cell for every id
+        Pages<size_t> next{12, 1};
+        // of the hashes of the occupied cells, 4 bits per slot of the table
+        CellFilter filter;
+        // cells freed since the filter was built, their hashes still pass it
+        size_t stale = 0;
+
+        // the slot of <hash> or the free one where it would go; the table is not empty
+        size_t find(unsigned long long hash) const {
+            size_t mask = table.size() - 1, at = hash & mask;
+            while (table[at].head != none && table[at].hash != hash) { at = (at + 1) & mask; }
+            return at;
+        }
+
+        // grows the table to hold <cells> occupied slots
+        void reserve(size_t cells) {
+            size_t size = std::max<size_t>(table.size(), 8);
+            while (size < 2 * cells) { size *= 2; }
+            if (size == table.size()) { return; }
+
+            std::vector<Slot> old;
+            old.reserve(occupied);
+            for (size_t k = 0; k < table.size(); k++) {
+                if (table[k].head != none) { old.push_back(table[k]); }
+            }
+            table.assign(size, Slot{0, none});
+            for (auto const& slot: old) { *table.change(find(slot.hash)) = slot; }
+            rebuildFilter();
+        }
+
+        // a filter of the occupied cells alone, sized for the table
+        void rebuildFilter() {
+            filter.reset(std::max<size_t>(table.size() / 16, 1));
+            stale = 0;
+            for (size_t k = 0; k < table.size(); k++) {
+                if (table[k].head != none) { filter.add(table[k].hash); }
+            }
+        }
+
+        // takes <id> out of the list of its cell, freeing the cell if it was the only one there
+        void unlink(size_t id, double const* point) {
+            size_t at = find(key(point));
+            if (table[at].head == id) {
+                table.change(at)->head = next[id];
+                if (table[at].head == none) { release(at); }
+            } else {
+                size_t k = table[at].head;
+                while (next[k] != id) { k = next[k]; }
+                *next.change(k) = next[id];
+            }
+        }
+
+        // frees slot <at> and moves back the slots after it that could no longer be found
+        void release(size_t at) {
+            size_t mask = table.size() - 1;
+            table.change(at)->head = none;
+            occupied--;
+            for (size_t k = (at + 1) & mask; table[k].head != none; k = (k + 1) & mask) {
+                size_t home = table[k].hash & mask;
+                bool reachable = at <= k ? (at < home && home <= k) : (at < home || home <= k);
+                if (!reachable) {
+                    *table.change(at) = table[k];
+                    table.change(k)->head = none;
+                    at = k;
+                }
+            }
+            // a new filter every table.size() / 8 frees costs O(1) a free
+            if (8 * ++stale > table.size()) { rebuildFilter(); }
+        }
+
+        long long cellOf(double x) const { return cellIndex(x, cell); }
+
+        bool isInCell(double const* point, long long const* at) const {
+            for (size_t i = 0; i < dim; i++) {
+                if (cellOf(point[i]) != at[i]) { return false; }
+            }
+            return true;
+        }
+
+        unsigned long long hash(long long const* at) const { return hashCell(at, dim); }
+
+        unsigned long long key(double const* point) const { return hashPointCell(point, dim, cell); }
+    };
+
+    /* points of a batch sorted by the hash of their cell, cells twice as wide as the tolerance,
+       so the points closer than the tolerance to a point lie in at most 2^dim runs of the sorted order,
+       found through an open addressing table of the runs. Boxes covering more cells than there are points
+       are answered by a scan of all points */
+    class BatchNeighbours {
+    public:
+        // <ids> are the points of <coords> to sort, in increasing order
+        BatchNeighbours(double const* coords, size_t dim, std::vector<size_t> const& ids,
+                        IVector::NORM norm, double tolerance):
+            coords(coords), dim(dim), ids(ids), norm(norm), tolerance(tolerance), cell(2 * tolerance), keys(ids.size()) {
+            if (std::isinf(tolerance)) { return; }
+
+            parallelFor(ids.size(), 4096, [&](size_t from, size_t to) {
+                for (size_t k = from; k < to; k++) {
+                    keys[k] = std::make_pair(hashPointCell(&coords[ids[k] * dim], dim, cell), ids[k]);
+                }
+            });
+            std::sort(keys.begin(), keys.end());
+
+            size_t size = 2;
+            while (size < 2 * keys.size()) { size *= 2; }
+            runs.assign(size, Run{0, 0, 0});
+            for (size_t k = 0; k < keys.size(); k++) {
+                if (k != 0 && keys[k].first == keys[k - 1].first) { continue; }
+                size_t slot = keys[k].first & (size - 1);
+                while (runs[slot].to != 0) { slot = (slot + 1) & (size - 1); }
+                runs[slot].hash = keys[k].first;
+                runs[slot].from = k;
+                runs[slot].to = k + 1;
+                while (runs[slot].to < keys.size() && keys[runs[slot].to].first == keys[k].first) { runs[slot].to++; }
+            }
+        }
+
+        // whether a point j < id with results[j] == SUCCESS is closer than the tolerance to point <id>,
+        // the same match as SetImpl::find of point <id> would give
+        bool hasEarlierMatch(size_t id, RESULT_CODE const* results) const {
+            double const* point = &coords[id * dim];
+            static thread_local std::vector<double> box;
+            box.resize(2 * dim);
+            double *lo = box.data(), *hi = lo + dim;
+            static thread_local std::vector<long long> cellBox;
+            cellBox.resize(3 * dim);
+            long long *from = cellBox.data(), *to = from + dim, *at = to + dim;
+            double cells = 1;
+            for (size_t i = 0; i < dim; i++) {
+                lo[i] = point[i] - tolerance;
+                hi[i] = point[i] + tolerance;
+                from[i] = cellIndex(lo[i], cell);
+                to[i] = cellIndex(hi[i], cell);
+                cells *= static_cast<double>(to[i] - from[i] + 1);
+            }
+
+            auto isMatch = [&](size_t j) {
+                double const* other = &coords[j * dim];
+                return results[j] == RESULT_CODE::SUCCESS && inside(other, lo, hi, dim)
+                    && distance(point, other, dim, norm) < tolerance;
+            };
+
+            if (std::isinf(tolerance) || cells > static_cast<double>(ids.size())) {
+                for (size_t k = 0; k < ids.size() && ids[k] < id; k++) {
+                    if (isMatch(ids[k])) { return true; }
+                }
+                return false;
+            }
+
+            // odometer over the cells of the box, a run may hold points of colliding cells, the box check drops them
+            std::copy(from, from + dim, at);
+            while (true) {
+                auto h = hashCell(at, dim);
+                size_t slot = h & (runs.size() - 1);
+                while (runs[slot].to != 0 && runs[slot].hash != h) { slot = (slot + 1) & (runs.size() - 1); }
+                for (size_t k = runs[slot].from; k < runs[slot].to && keys[k].second < id; k++) {
+                    if (isMatch(keys[k].second)) { return true; }
+                }
+
+                size_t i = 0;
+                while (i < dim && at[i] == to[i]) {
+                    at[i] = from[i];
+                    i++;
+                }
+                if (i == dim) { break; }
+                at[i]++;
+            }
+            return false;
+        }
+
+    private:
+        double const* coords;
+        size_t dim;
+        std::vector<size_t> const& ids;
+        IVector::NORM norm;
+        double tolerance, cell;
+        // (cell hash, id) in increasing order
+        std::vector<std::pair<unsigned long long, size_t>> keys;
+
+        // keys[from, to) share <hash>, to == 0 for a free slot
+        struct Run {
+            unsigned long long hash;
+            size_t from, to;
+        };
+        std::vector<Run> runs;
+    };
+
+    // what the set operations need of an operand besides ISet, whatever its index is
+    class SetBase: public ISet {
+    public:
+        using ISet::forEach;
+
+        virtual Storage const& getElements() const = 0;
+
+        // smallest index of an element closer than <tolerance> to <point>, none if there is none; thread safe
+        virtual size_t find(double const* point, IVector::NORM norm, double tolerance) const = 0;
+
+        // appends to <found> the indices of all elements closer than <tolerance> to <point>, in no particular order; thread safe
+        virtual void findAll(double const* point, IVector::NORM norm, double tolerance, std::vector<size_t>& found) const = 0;
+
+        /* inserts count points of <dim> stored one after another as inserts in this order would,
+           except those with results[k] != SUCCESS; results[k] gets MULTIPLE_DEFINITION for the rejected ones.
+           The dimension should be the one of the set unless it is empty */
+        virtual void insertPoints(double const* coords, size_t count, size_t dim, IVector::NORM norm, double tolerance,
+                                  RESULT_CODE* results) = 0;
+    };
+
+    template<class Index>
+    class SetImpl: public SetBase {
+    private:
+        Storage elements;
+        Index spatialIndex;
+        ILogger* pLogger;
+
+    public:
+        Storage const& getElements() const override { return elements; }
+
+        size_t find(double const* point, IVector::NORM norm, double tolerance) const override {
+            size_t dim = elements.getDim(), found = none;
+            // every norm bounds each coordinate difference, so the matches lie in the box point +- tolerance
+            static thread_local std::vector<double> box;
+            box.resize(2 * dim);
+            double *lo = box.data(), *hi = lo + dim;
+            for (size_t i = 0; i < dim; i++) {
+                lo[i] = point[i] - tolerance;
+                hi[i] = point[i] + tolerance;
+            }
+
+            spatialIndex.query(elements, lo, hi, [&](size_t id, double const* coords) {
+                if (id < found && distance(point, coords, dim, norm) < tolerance) { found = id; }
+            });
+            return found;
+        }
+
+        void findAll(double const* point, IVector::NORM norm, double tolerance, std::vector<size_t>& found) const override {
+            size_t dim = elements.getDim();
+            static thread_local std::vector<double> box;
+            box.resize(2 * dim);
+            double *lo = box.data(), *hi = lo + dim;
+            for (size_t i = 0; i < dim; i++) {
+                lo[i] = point[i] - tolerance;
+                hi[i] = point[i] + tolerance;
+            }
+
+            spatialIndex.query(elements, lo, hi, [&](size_t id, double const* coords) {
+                if (distance(point, coords, dim, norm) < tolerance) { found.push_back(id); }
+            });
+        }
+
+        /* three passes: every point is checked against the present elements in parallel,
+           then the points that are left are checked against the earlier ones of the batch in parallel;
+           a point with no earlier match is accepted whatever happens to the others, so only the points with
+           matches are resolved in input order: rejected if a match is accepted. Accepted points are indexed at once */
+        void insertPoints(double const* coords, size_t count, size_t dim, IVector::NORM norm, double tolerance,
+                          RESULT_CODE* results) override {
+            if (getSize() == 0) {
+                elements.reset(dim);
+                spatialIndex.reset(dim);
+            } else {
+                parallelFor(count, 1024, [&](size_t from, size_t to) {
+                    for (size_t k = from; k < to; k++) {
+                        if (results[k] == RESULT_CODE::SUCCESS && find(coords + k * dim, norm, tolerance) != none) {
+                            results[k] = RESULT_CODE::MULTIPLE_DEFINITION;
+                        }
+                    }
+                });
+            }
+
+            // nothing is closer than zero
+            if (tolerance > 0) {
+                std::vector<size_t> left;
+                for (size_t k = 0; k < count; k++) {
+                    if (results[k] == RESULT_CODE::SUCCESS) { left.push_back(k); }
+                }
+
+                BatchNeighbours neighbours(coords, dim, left, norm, tolerance);
+                std::vector<char> hasMatch(left.size());
+                parallelFor(left.size(), 1024, [&](size_t from, size_t to) {
+                    for (size_t k = from; k < to; k++) { hasMatch[k] = neighbours.hasEarlierMatch(left[k], results); }
+                });
+
+                for (size_t k = 0; k < left.size(); k++) {
+                    if (hasMatch[k] && neighbours.hasEarlierMatch(left[k], results)) {
+                        results[left[k]] = RESULT_CODE::MULTIPLE_DEFINITION;
+                    }
+                }
+            }
+
+            std::vector<double> accepted;
+            for (size_t k = 0; k < count; k++) {
+                if (results[k] == RESULT_CODE::SUCCESS) { accepted.insert(accepted.end(), coords + k * dim, coords + (k + 1) * dim); }
+            }
+            if (!accepted.empty()) {
+                size_t first = getSize();
+                elements.append(accepted.data(), accepted.size() / dim);
+                spatialIndex.insert(elements, first, accepted.size() / dim);
+            }
+        }
+
+    private:
+        static std::vector<double> coordsOf(IVector const* pVector) {
+            std::vector<double> coords(pVector->getDim());
+            for (size_t i = 0; i < coords.size(); i++) { coords[i] = pVector->getCoord(i); }
+            return coords;
+        }
+
+        // visit(id) for every element in the box of <pBox>, in no particular order
+        template<class Visit>
+        RESULT_CODE visitBox(ICompact const* pBox, char const* method, Visit&& visit) const {
+            if (pBox == nullptr) {
+                if (pLogger != nullptr) {
+                    pLogger->log((std::string("in SetImpl::") + method + ": null param").c_str(), RESULT_CODE::BAD_REFERENCE);
+                }
+                return RESULT_CODE::BAD_REFERENCE;
+            }
+            if (getSize() == 0) { return RESULT_CODE::SUCCESS; }
+
+            if (pBox->getDim() != getDim()) {
+                if (pLogger != nullptr) {
+                    pLogger->log((std::string("in SetImpl::") + method).c_str(), RESULT_CODE::WRONG_DIM);
+                }
+                return RESULT_CODE::WRONG_DIM;
+            }
+
+            std::unique_ptr<IVector> begin(pBox->getBegin()), end(pBox->getEnd());
+            if (begin == nullptr || end == nullptr) {
+                if (pLogger != nullptr) {
+                    pLogger->log((std::string("in SetImpl::") + method + ": no box bounds").c_str(), RESULT_CODE::BAD_REFERENCE);
+                }
+                return RESULT_CODE::BAD_REFERENCE;
+            }
+
+            auto lo = coordsOf(begin.get()), hi = coordsOf(end.get());
+            spatialIndex.query(elements, lo.data(), hi.data(), [&](size_t id, double const*) { visit(id); });
+            return RESULT_CODE::SUCCESS;
+        }
+
+        // indices of the elements in the box of <pBox> in increasing order
+        RESULT_CODE findInBox(ICompact const* pBox, std::vector<size_t>& found, char const* method) const {
+            auto rc = visitBox(pBox, method, [&](size_t id) { found.push_back(id); });
+            std::sort(found.begin(), found.end());
+            return rc;
+        }
+
+        // the smallest index of an element closer than <tolerance> to pSample, NOT_FOUND if there is none
+        RESULT_CODE findSample(IVector const* pSample, IVector::NORM norm, double tolerance, char const* method,
+                               size_t& found) const {
+            if (std::isnan(tolerance) || tolerance < 0 || pSample == nullptr || pSample->getDim() != getDim()) {
+                if (pLogger != nullptr) {
+                    pLogger->log((std::string("in SetImpl::") + method + ": null or wrong dimension sample").c_str(),
+                                 RESULT_CODE::BAD_REFERENCE);
+                }
+                return RESULT_CODE::BAD_REFERENCE;
+            }
+
+            found = find(coordsOf(pSample).data(), norm, tolerance);
+            if (found == none) {
+                if (pLogger != nullptr) {
+                    pLogger->log((std::string("in SetImpl::") + method).c_str(), RESULT_CODE::NOT_FOUND);
+                }
+                return RESULT_CODE::NOT_FOUND;
+            }
+            return RESULT_CODE::SUCCESS;
+        }
+
+        // erases the elements of <ids>, given in increasing order, the rest keep their order
+        void eraseSorted(std::vector<size_t> const& ids) {
+            // one pass over the index and one compaction of the buffer instead of a shift per element
+            spatialIndex.eraseShift(elements, ids);
+            elements.erase(ids);
+        }
+
+        IVector* makeVector(size_t index) const {
+            auto cloneElem = IVector::createVector(elements.getDim(), const_cast<double*>(elements.point(index)), pLogger);
+            if (cloneElem == nullptr && pLogger != nullptr) {
+                pLogger->log("in SetImpl::get: nullptr", RESULT_CODE::BAD_REFERENCE);
+            }
+            return cloneElem;
+        }
+
+        SetImpl(SetImpl const& set) = delete;
+        SetImpl& operator=(SetImpl const& set) = delete;
+
+    public:
+        // <spatialIndex> is an empty index, configured
+        SetImpl(ILogger* pLogger, Index const& spatialIndex) : spatialIndex(spatialIndex), pLogger(pLogger) {}
+
+        ~SetImpl() override = default;
+
+        RESULT_CODE insert(const IVector* pVector,IVector::NORM norm, double tolerance) override {
+            if (std::isnan(tolerance) || tolerance < 0) {
+                if (pLogger != nullptr) {
+                    pLogger->log("in SetImpl::insert: NAN tolerance", RESULT_CODE::NAN_VALUE);
+                }
+                return RESULT_CODE::NAN_VALUE;
+            }
+
+            if (pVector == nullptr) {
+                if (pLogger != nullptr)
+                    pLogger->log("in SetImpl::insert: null param", RESULT_CODE::BAD_REFERENCE);
+                return RESULT_CODE::BAD_REFERENCE;
+            }
+
+            if (getSize() != 0) {
+                if (pVector->getDim() != getDim()) {
+                    if (pLogger != nullptr) {
+                        pLogger->log("in SetImpl::insert", RESULT_CODE::WRONG_DIM);
+                    }
+                    return RESULT_CODE::WRONG_DIM;
+                }
+            } else {
+                elements.reset(pVector->getDim());
+                spatialIndex.reset(pVector->getDim());
+            }
+
+            auto coords = coordsOf(pVector);
+            if (find(coords.data(), norm, tolerance) != none) {
+                if (pLogger != nullptr) {
+                    pLogger->log("in SetImpl::insert", RESULT_CODE::MULTIPLE_DEFINITION);
+                }
+                return RESULT_CODE::MULTIPLE_DEFINITION;
+            }
+
+            elements.push(coords.data());
+            spatialIndex.insert(elements, getSize() - 1, 1);
+            return RESULT_CODE::SUCCESS;
+        }
+
+        RESULT_CODE insertBulk(IVector const* const* pVectors, size_t count, IVector::NORM norm, double tolerance,
+                               RESULT_CODE* status) override {
+            if (std::isnan(tolerance) || tolerance < 0) {
+                if (pLogger != nullptr) {
+                    pLogger->log("in SetImpl::insertBulk: NAN tolerance", RESULT_CODE::NAN_VALUE);
+                }
+                return RESULT_CODE::NAN_VALUE;
+            }
+
+            if (pVectors == nullptr && count != 0) {
+                if (pLogger != nullptr) {
+                    pLogger->log("in SetImpl::insertBulk: null param", RESULT_CODE::BAD_REFERENCE);
+                }
+                return RESULT_CODE::BAD_REFERENCE;
+            }
+
+            // an empty set takes the dimension of the first point, as the first insert would
+            size_t dim = getDim();
+            for (size_t k = 0; k < count && dim == 0; k++) {
+                if (pVectors[k] != nullptr) { dim = pVectors[k]->getDim(); }
+            }
+
+            std::vector<RESULT_CODE> results(count, RESULT_CODE::SUCCESS);
+            std::vector<double> coords(count * dim);
+            parallelFor(count, 1024, [&](size_t from, size_t to) {
+                for (size_t k = from; k < to; k++) {
+                    if (pVectors[k] == nullptr) {
+                        results[k] = RESULT_CODE::BAD_REFERENCE;
+                        continue;
+                    }
+                    if (pVectors[k]->getDim() != dim) {
+                        results[k] = RESULT_CODE::WRONG_DIM;
+                        continue;
+                    }
+
+                    for (size_t i = 0; i < dim; i++) { coords[k * dim + i] = pVectors[k]->getCoord(i); }
+                }
+            });
+            insertPoints(coords.data(), count, dim, norm, tolerance, results.data());
+
+            if (status != nullptr) { std::copy(results.begin(), results.end(), status); }
+            return RESULT_CODE::SUCCESS;
+        }
+
+        RESULT_CODE get(IVector*& pVector, size_t index) const override {
+            if (index >= getSize()) {
+                if (pLogger != nullptr) {
+                    pLogger->log("in SetImpl::get", RESULT_CODE::OUT_OF_BOUNDS);
+                }
+                return RESULT_CODE::OUT_OF_BOUNDS;
+            }
+
+            auto cloneElem = makeVector(index);
+            if (cloneElem == nullptr) { return RESULT_CODE::BAD_REFERENCE; }
+
+            pVector = cloneElem;
+            return RESULT_CODE::SUCCESS;
+        }
+
+        RESULT_CODE get(IVector*& pVector, IVector const* pSample, IVector::NORM norm, double tolerance) const override {
+            if (std::isnan(tolerance) || tolerance < 0) {
+                if (pLogger != nullptr) {
+                    pLogger->log("in SetImpl::get: NAN tolerance", RESULT_CODE::NAN_VALUE);
+                }
+                return RESULT_CODE::NAN_VALUE;
+            }
+
+            if (pSample == nullptr) {
+                if (pLogger != nullptr) {
+                    pLogger->log("in SetImpl::get: null param", RESULT_CODE::BAD_REFERENCE);
+                }
+                return RESULT_CODE::BAD_REFERENCE;
+            }
+
+            if (pSample->getDim() != getDim()) {
+                if (pLogger != nullptr) {
+                    pLogger->log("in SetImpl::get", RESULT_CODE::WRONG_DIM);
+                }
+                return RESULT_CODE::WRONG_DIM;
+            }
+
+            auto found = find(coordsOf(pSample).data(), norm, tolerance);
+            if (found != none) {
+                auto cloneElem = makeVector(found);
+                if (cloneElem == nullptr) { return RESULT_CODE::BAD_REFERENCE; }
+
+                pVector = cloneElem;
+                return RESULT_CODE::SUCCESS;
+            }
+
+            if (pLogger != nullptr) {
+                pLogger->log("in SetImpl::get", RESULT_CODE::NOT_FOUND);
+            }
+            return RESULT_CODE::NOT_FOUND;
+        }
+
+        //space dimension
+        size_t getDim() const override {
+            if (getSize() == 0) { return 0; }
+            return elements.getDim();
+        }
+
+        //num elements in set
+        size_t getSize() const override { return elements.getSize(); }
+
+        void clear() override {
+            elements.reset(0);
+            spatialIndex.reset(0);
+        }
+
+        RESULT_CODE erase(size_t index) override {
+            if (index >= getSize()) {
+                if (pLogger != nullptr) {
+                    pLogger->log("ISet::erase", RESULT_CODE::OUT_OF_BOUNDS);
+                }
+                return RESULT_CODE::OUT_OF_BOUNDS;
+            }
+
+            eraseSorted(std::vector<size_t>(1, index));
+            return RESULT_CODE::SUCCESS;
+        }
+
+        RESULT_CODE erase(IVector const* pSample, IVector::NORM norm, double tolerance) override {
+            size_t found;
+            auto rc = findSample(pSample, norm, tolerance, "erase", found);
+            return rc == RESULT_CODE::SUCCESS ? erase(found) : rc;
+        }
+
+        RESULT_CODE swapErase(size_t index) override {
+            if (index >= getSize()) {
+                if (pLogger != nullptr) {
+                    pLogger->log("in SetImpl::swapErase", RESULT_CODE::OUT_OF_BOUNDS);
+                }
+                return RESULT_CODE::OUT_OF_BOUNDS;
+            }
+
+            size_t last = getSize() - 1;
+            spatialIndex.swapErase(elements, index, elements.point(index), last, elements.point(last));
+            elements.swapErase(index);
+            return RESULT_CODE::SUCCESS;
+        }
+
+        RESULT_CODE swapErase(IVector const* pSample, IVector::NORM norm, double tolerance) override {
+            size_t found;
+            auto rc = findSample(pSample, norm, tolerance, "swapErase", found);
+            return rc == RESULT_CODE::SUCCESS ? swapErase(found) : rc;
+        }
+
+        RESULT_CODE forEach(Visitor& visitor) const override {
+            for (size_t k = 0; k < getSize(); k++) {
+                if (!visitor.visit(k, elements.point(k))) { break; }
+            }
+            return RESULT_CODE::SUCCESS;
+        }
+
+        // a span is the rest of a page of the storage
+        size_t getSpan(size_t first, double const*& coords) const override {
+            if (first >= getSize()) { return 0; }
+            coords = elements.point(first);
+            return elements.run(first);
+        }
+
+        RESULT_CODE knn(IVector const* pSample, IVector::NORM norm, size_t k, size_t* indices, size_t& count) const override {
+            count = 0;
+            if (pSample == nullptr || (indices == nullptr && k != 0)) {
+                if (pLogger != nullptr) {
+                    pLogger->log("in SetImpl::knn: null param", RESULT_CODE::BAD_REFERENCE);
+                }
+                return RESULT_CODE::BAD_REFERENCE;
+            }
+            if (getSize() == 0) { return RESULT_CODE::SUCCESS; }
+
+            if (pSample->getDim() != getDim()) {
+                if (pLogger != nullptr) {
+                    pLogger->log("in SetImpl::knn", RESULT_CODE::WRONG_DIM);
+                }
+                return RESULT_CODE::WRONG_DIM;
+            }
+
+            std::vector<Neighbour> best;
+            spatialIndex.nearest(elements, coordsOf(pSample).data(), k, norm, best);
+            for (auto const& neighbour: best) { indices[count++] = neighbour.second; }
+            return RESULT_CODE::SUCCESS;
+        }
+
+        RESULT_CODE radiusQuery(IVector const* pSample, IVector::NORM norm, double radius, Visitor& visitor) const override {
+            if (std::isnan(radius) || radius < 0) {
+                if (pLogger != nullptr) {
+                    pLogger->log("in SetImpl::radiusQuery: NAN radius", RESULT_CODE::NAN_VALUE);
+                }
+                return RESULT_CODE::NAN_VALUE;
+            }
+
+            if (pSample == nullptr) {
+                if (pLogger != nullptr) {
+                    pLogger->log("in SetImpl::radiusQuery: null param", RESULT_CODE::BAD_REFERENCE);
+                }
+                return RESULT_CODE::BAD_REFERENCE;
+            }
+            if (getSize() == 0) { return RESULT_CODE::SUCCESS; }
+
+            if (pSample->getDim() != getDim()) {
+                if (pLogger != nullptr) {
+                    pLogger->log("in SetImpl::radiusQuery", RESULT_CODE::WRONG_DIM);
+                }
+                return RESULT_CODE::WRONG_DIM;
+            }
+
+            size_t dim = getDim();
+            auto point = coordsOf(pSample);
+            std::vector<double> box(2 * dim);
+            double *lo = box.data(), *hi = lo + dim;
+            for (size_t i = 0; i < dim; i++) {
+                lo[i] = point[i] - radius;
+                hi[i] = point[i] + radius;
+            }
+
+            std::vector<size_t> found;
+            spatialIndex.query(elements, lo, hi, [&](size_t id, double const* coords) {
+                if (distance(point.data(), coords, dim, norm) <= radius) { found.push_back(id); }
+            });
+            std::sort(found.begin(), found.end());
+
+            for (auto id: found) {
+                if (!visitor.visit(id, elements.point(id))) { break; }
+            }
+            return RESULT_CODE::SUCCESS;
+        }
+
+        RESULT_CODE countInBox(ICompact const* pBox, size_t& count) const override {
+            count = 0;
+            return visitBox(pBox, "countInBox", [&](size_t) { count++; });
+        }
+
+        RESULT_CODE queryBox(ICompact const* pBox, Visitor& visitor) const override {
+            std::vector<size_t> found;
+            auto rc = findInBox(pBox, found, "queryBox");
+            for (auto id: found) {
+                if (!visitor.visit(id, elements.point(id))) { break; }
+            }
+            return rc;
+        }
+
+        RESULT_CODE eraseInBox(ICompact const* pBox, size_t& erased) override {
+            std::vector<size_t> found;
+            auto rc = findInBox(pBox, found, "eraseInBox");
+            eraseSorted(found);
+            erased = found.size();
+            return rc;
+        }
+
+        RESULT_CODE eraseIf(Visitor& predicate, size_t& erased) override {
+            std::vector<size_t> marked;
+            for (size_t k = 0; k < getSize(); k++) {
+                if (predicate.visit(k, elements.point(k))) { marked.push_back(k); }
+            }
+            eraseSorted(marked);
+            erased = marked.size();
+            return RESULT_CODE::SUCCESS;
+        }
+
+        // shares the pages of the storage and the index with this set until either changes them
+        ISet* clone() const override {
+            SetImpl *set = new (std::nothrow) SetImpl(pLogger, spatialIndex);
+            if (set == nullptr) {
+                if (pLogger != nullptr) {
+                    pLogger->log("in ISet::clone: out of memory", RESULT_CODE::OUT_OF_MEMORY);
+                }
+                return nullptr;
+            }
+
+            set->elements = elements;
+            return set;
+        }
+
+        RESULT_CODE save(char const* path) const override {
+            if (path == nullptr) {
+                if (pLogger != nullptr) {
+                    pLogger->log("in SetImpl::save: null param", RESULT_CODE::BAD_REFERENCE);
+                }
+                return RESULT_CODE::BAD_REFERENCE;
+            }
+
+            SetFileHeader header = {SetFileHeader::signature, SetFileHeader::currentVersion, sizeof(size_t), Index::fileKind,
+                                    getDim(), getSize(), spatialIndex.getCell()};
+            FileWriter file(path);
+            file.write(&header, sizeof(header));
+            elements.save(file);
+            spatialIndex.save(file);
+            if (!file.close()) {
+                if (pLogger != nullptr) {
+                    pLogger->log("in SetImpl::save: cannot write file", RESULT_CODE::FILE_ERROR);
+                }
+                return RESULT_CODE::FILE_ERROR;
+            }
+            return RESULT_CODE::SUCCESS;
+        }
+
+        // maps the storage and the index from <file>, false if they do not fit together
+        bool load(FileReader& file, size_t dim) {
+            return elements.load(file, dim) && spatialIndex.load(file, dim) && spatialIndex.getSize() == elements.getSize();
+        }
+    };
+
+    /* set for threads that insert and look up at once: points are spread over shards by their grid cell, cells twice
+       as wide as the tolerance, every shard has its own lock, storage and grid. An insert locks the shards of all cells
+       its tolerance box touches, so two points that could match always share a locked shard and dedup holds across
+       shard boundaries; inserts far apart run in parallel. Only the append of the global index is serialized.
+       The other operations lock the shards they read or the whole set */
+    class ConcurrentSet: public ISet {
+    public:
+        ConcurrentSet(ILogger* pLogger, double cell): cell(cell), pLogger(pLogger) {
+            for (size_t k = 0; k < shardCount; k++) { shards.emplace_back(new Shard(cell)); }
+        }
+
+        ~ConcurrentSet() override = default;
+
+        RESULT_CODE insert(const IVector* pVector, IVector::NORM norm, double tolerance) override {
+            if (std::isnan(tolerance) || tolerance < 0) {
+                if (pLogger != nullptr) {
+                    pLogger->log("in ConcurrentSet::insert: NAN tolerance", RESULT_CODE::NAN_VALUE);
+                }
+                return RESULT_CODE::NAN_VALUE;
+            }
+
+            if (pVector == nullptr) {
+                if (pLogger != nullptr) {
+                    pLogger->log("in ConcurrentSet::insert: null param", RESULT_CODE::BAD_REFERENCE);
+                }
+                return RESULT_CODE::BAD_REFERENCE;
+            }
+
+            auto rc = tryInsert(pVector, norm, tolerance);
+            if (rc != RESULT_CODE::SUCCESS && pLogger != nullptr) {
+                pLogger->log("in ConcurrentSet::insert", rc);
+            }
+            return rc;
+        }
+
+        // one insert after another, other threads may insert in between
+        RESULT_CODE insertBulk(IVector const* const* pVectors, size_t count, IVector::NORM norm, double tolerance,
+                               RESULT_CODE* status) override {
+            if (std::isnan(tolerance) || tolerance < 0) {
+                if (pLogger != nullptr) {
+                    pLogger->log("in ConcurrentSet::insertBulk: NAN tolerance", RESULT_CODE::NAN_VALUE);
+                }
+                return RESULT_CODE::NAN_VALUE;
+            }
+
+            if (pVectors == nullptr && count != 0) {
+                if (pLogger != nullptr) {
+                    pLogger->log("in ConcurrentSet::insertBulk: null param", RESULT_CODE::BAD_REFERENCE);
+                }
+                return RESULT_CODE::BAD_REFERENCE;
+            }
+
+            // rejected points are reported by status only, as SetImpl::insertBulk does
+            for (size_t k = 0; k < count; k++) {
+                auto rc = pVectors[k] != nullptr ? tryInsert(pVectors[k], norm, tolerance) : RESULT_CODE::BAD_REFERENCE;
+                if (status != nullptr) { status[k] = rc; }
+            }
+            return RESULT_CODE::SUCCESS;
+        }
+
+        RESULT_CODE get(IVector*& pVector, size_t index) const override {
+            std::pair<size_t, size_t> at;
+            std::unique_lock<std::mutex> shardLock;
+            if (!lockElement(index, at, shardLock)) {
+                if (pLogger != nullptr) {
+                    pLogger->log("in ConcurrentSet::get", RESULT_CODE::OUT_OF_BOUNDS);
+                }
+                return RESULT_CODE::OUT_OF_BOUNDS;
+            }
+            return makeVector(pVector, shards[at.first]->elements.point(at.second));
+        }
+
+        RESULT_CODE get(IVector*& pVector, IVector const* pSample, IVector::NORM norm, double tolerance) const override {
+            if (std::isnan(tolerance) || tolerance < 0) {
+                if (pLogger != nullptr) {
+                    pLogger->log("in ConcurrentSet::get: NAN tolerance", RESULT_CODE::NAN_VALUE);
+                }
+                return RESULT_CODE::NAN_VALUE;
+            }
+
+            if (pSample == nullptr) {
+                if (pLogger != nullptr) {
+                    pLogger->log("in ConcurrentSet::get: null param", RESULT_CODE::BAD_REFERENCE);
+                }
+                return RESULT_CODE::BAD_REFERENCE;
+            }
+
+            if (pSample->getDim() != getDim()) {
+                if (pLogger != nullptr) {
+                    pLogger->log("in ConcurrentSet::get", RESULT_CODE::WRONG_DIM);
+                }
+                return RESULT_CODE::WRONG_DIM;
+            }
+
+            // the match of the smallest index over the shards around the sample
+            auto point = coordsOf(pSample);
+            auto locks = lockAround(point.data(), tolerance);
+            size_t found = none;
+            double const* coords = nullptr;
+            for (auto const& locked: locks) {
+                Shard const& shard = *shards[locked.first];
+                size_t local = shard.find(point.data(), norm, tolerance);
+                if (local != none && shard.ids[local] < found) {
+                    found = shard.ids[local];
+                    coords = shard.elements.point(local);
+                }
+            }
+
+            if (found != none) { return makeVector(pVector, coords); }
+
+            if (pLogger != nullptr) {
+                pLogger->log("in ConcurrentSet::get", RESULT_CODE::NOT_FOUND);
+            }
+            return RESULT_CODE::NOT_FOUND;
+        }
+
+        size_t getDim() const override { return getSize() != 0 ? dim.load() : 0; }
+
+        size_t getSize() const override {
+            std::lock_guard<std::mutex> guard(orderLock);
+            return order.size();
+        }
+
+        void clear() override {
+            auto locks = lockAll();
+            for (auto &shard: shards) {
+                shard->elements.reset(0);
+                shard->index.reset(0);
+                shard->ids.clear();
+                shard->shuffled = false;
+            }
+            order.clear();
+            dim = 0;
+        }
+
+        RESULT_CODE erase(size_t index) override {
+            auto locks = lockAll();
+            if (index >= order.size()) {
                 if (pLogger != nullptr) {
-                    pLogger->log("in SetImpl::insert: NAN tolerance", RESULT_CODE::NAN_VALUE);
+                    pLogger->log("in ConcurrentSet::erase", RESULT_CODE::OUT_OF_BOUNDS);
                 }
-                return RESULT_CODE::NAN_VALUE;
+                return RESULT_CODE::OUT_OF_BOUNDS;
             }
 
-            if (pVector == nullptr) {
-                if (pLogger != nullptr)
-                    pLogger->log("in SetImpl::insert: null param", RESULT_CODE::BAD_REFERENCE);
+            eraseSorted(std::vector<size_t>(1, index));
+            return RESULT_CODE::SUCCESS;
+        }
+
+        RESULT_CODE erase(IVector const* pSample, IVector::NORM norm, double tolerance) override {
+            if (std::isnan(tolerance) || tolerance < 0 || pSample == nullptr || pSample->getDim() != getDim()) {
+                if (pLogger != nullptr) {
+                    pLogger->log("in ConcurrentSet::erase: null or wrong dimension sample", RESULT_CODE::BAD_REFERENCE);
+                }
                 return RESULT_CODE::BAD_REFERENCE;
             }
 
-            if (!elements.empty()) {
-                if (pVector->getDim() != getDim()) {
-                    if (pLogger != nullptr) {
-                        pLogger->log("in SetImpl::insert", RESULT_CODE::WRONG_DIM);
-                    }
-                    return RESULT_CODE::WRONG_DIM;
+            auto locks = lockAll();
+            size_t found = findLocked(coordsOf(pSample).data(), norm, tolerance);
+            if (found == none) {
+                if (pLogger != nullptr) {
+                    pLogger->log("in ConcurrentSet::erase", RESULT_CODE::NOT_FOUND);
                 }
+                return RESULT_CODE::NOT_FOUND;
             }
 
-            IVector *diff;
-            for (auto elem: elements) {
-                diff = IVector::sub(pVector, elem, pLogger);
+            eraseSorted(std::vector<size_t>(1, found));
+            return RESULT_CODE::SUCCESS;
+        }
 
-                if (diff == nullptr) {
-                    if (pLogger != nullptr) {
-                        pLogger->log("in SetImpl::insert", RESULT_CODE::BAD_REFERENCE);
-                    }
-                    return RESULT_CODE::BAD_REFERENCE;
+        RESULT_CODE swapErase(size_t index) override {
+            auto locks = lockAll();
+            if (index >= order.size()) {
+                if (pLogger != nullptr) {
+                    pLogger->log("in ConcurrentSet::swapErase", RESULT_CODE::OUT_OF_BOUNDS);
                 }
+                return RESULT_CODE::OUT_OF_BOUNDS;
+            }
 
-                if (diff->norm(norm) < tolerance) {
-                    delete diff;
+            swapEraseLocked(index);
+            return RESULT_CODE::SUCCESS;
+        }
 
-                    if (pLogger != nullptr) {
-                        pLogger->log("in SetImpl::insert", RESULT_CODE::MULTIPLE_DEFINITION);
-                    }
-                    return RESULT_CODE::MULTIPLE_DEFINITION;
+        RESULT_CODE swapErase(IVector const* pSample, IVector::NORM norm, double tolerance) override {
+            if (std::isnan(tolerance) || tolerance < 0 || pSample == nullptr || pSample->getDim() != getDim()) {
+                if (pLogger != nullptr) {
+                    pLogger->log("in ConcurrentSet::swapErase: null or wrong dimension sample", RESULT_CODE::BAD_REFERENCE);
                 }
-                delete diff;
+                return RESULT_CODE::BAD_REFERENCE;
             }
 
-            auto cloneElem = pVector->clone();
-            if (cloneElem == nullptr) {
+            auto locks = lockAll();
+            size_t found = findLocked(coordsOf(pSample).data(), norm, tolerance);
+            if (found == none) {
                 if (pLogger != nullptr) {
-                    pLogger->log("in SetImpl::get: nullptr", RESULT_CODE::BAD_REFERENCE);
+                    pLogger->log("in ConcurrentSet::swapErase", RESULT_CODE::NOT_FOUND);
                 }
-                return RESULT_CODE::BAD_REFERENCE;
+                return RESULT_CODE::NOT_FOUND;
             }
 
-            elements.push_back(cloneElem);
+            swapEraseLocked(found);
             return RESULT_CODE::SUCCESS;
         }
 
-        RESULT_CODE get(IVector*& pVector, size_t index) const override {
-            if (index >= elements.size()) {
+        ISet* clone() const override {
+            ConcurrentSet *set = new (std::nothrow) ConcurrentSet(pLogger, cell);
+            if (set == nullptr) {
                 if (pLogger != nullptr) {
-                    pLogger->log("in SetImpl::get", RESULT_CODE::OUT_OF_BOUNDS);
+                    pLogger->log("in ConcurrentSet::clone: out of memory", RESULT_CODE::OUT_OF_MEMORY);
                 }
-                return RESULT_CODE::OUT_OF_BOUNDS;
+                return nullptr;
             }
 
-            auto cloneElem = elements[index]->clone();
-            if (cloneElem == nullptr) {
+            auto locks = lockAll();
+            for (size_t k = 0; k < shardCount; k++) {
+                set->shards[k]->elements = shards[k]->elements;
+                set->shards[k]->index = shards[k]->index;
+                set->shards[k]->ids = shards[k]->ids;
+                set->shards[k]->shuffled = shards[k]->shuffled;
+            }
+            set->order = order;
+            set->dim = dim.load();
+            return set;
+        }
+
+        // the visitor runs with the whole set locked and should not change it
+        RESULT_CODE forEach(Visitor& visitor) const override {
+            auto locks = lockAll();
+            for (size_t k = 0; k < order.size(); k++) {
+                if (!visitor.visit(k, shards[order[k].first]->elements.point(order[k].second))) { break; }
+            }
+            return RESULT_CODE::SUCCESS;
+        }
+
+        /* elements are spread over the shards, a span holds one of them. Writers change the pages of a shard in place,
+           so the span is a copy owned by the calling thread, valid until its next getSpan of a concurrent set */
+        size_t getSpan(size_t first, double const*& coords) const override {
+            static thread_local std::vector<double> span;
+            std::pair<size_t, size_t> at;
+            std::unique_lock<std::mutex> shardLock;
+            if (!lockElement(first, at, shardLock)) { return 0; }
+            double const* point = shards[at.first]->elements.point(at.second);
+            span.assign(point, point + shards[at.first]->elements.getDim());
+            coords = span.data();
+            return 1;
+        }
+
+        RESULT_CODE knn(IVector const* pSample, IVector::NORM norm, size_t k, size_t* indices, size_t& count) const override {
+            count = 0;
+            if (pSample == nullptr || (indices == nullptr && k != 0)) {
                 if (pLogger != nullptr) {
-                    pLogger->log("in SetImpl::get: nullptr", RESULT_CODE::BAD_REFERENCE);
+                    pLogger->log("in ConcurrentSet::knn: null param", RESULT_CODE::BAD_REFERENCE);
                 }
                 return RESULT_CODE::BAD_REFERENCE;
             }
 
-            pVector = cloneElem;
+            auto locks = lockAll();
+            if (order.empty()) { return RESULT_CODE::SUCCESS; }
+            if (pSample->getDim() != dim.load()) {
+                if (pLogger != nullptr) {
+                    pLogger->log("in ConcurrentSet::knn", RESULT_CODE::WRONG_DIM);
+                }
+                return RESULT_CODE::WRONG_DIM;
+            }
+
+            // the k best of every shard hold the k best of the set
+            auto point = coordsOf(pSample);
+            std::vector<Neighbour> best, ofShard;
+            for (auto const& shard: shards) {
+                if (shard->elements.getSize() == 0) { continue; }
+                shard->index.nearest(shard->elements, point.data(), k, norm, ofShard);
+                if (shard->shuffled && ofShard.size() == k) {
+                    // the ties of the k-th of the shard may have smaller global indices than the ones it kept
+                    double worst = ofShard.back().first;
+                    std::vector<double> box(2 * point.size());
+                    for (size_t i = 0; i < point.size(); i++) {
+                        box[i] = point[i] - worst;
+                        box[point.size() + i] = point[i] + worst;
+                    }
+                    ofShard.clear();
+                    shard->index.query(shard->elements, box.data(), box.data() + point.size(), [&](size_t local, double const* coords) {
+                        double d = distance(point.data(), coords, point.size(), norm);
+                        if (d <= worst) { ofShard.push_back(Neighbour(d, local)); }
+                    });
+                }
+                for (auto const& neighbour: ofShard) { offer(best, k, Neighbour(neighbour.first, shard->ids[neighbour.second])); }
+            }
+            std::sort_heap(best.begin(), best.end());
+            for (auto const& neighbour: best) { indices[count++] = neighbour.second; }
             return RESULT_CODE::SUCCESS;
         }
 
-        RESULT_CODE get(IVector*& pVector, IVector const* pSample, IVector::NORM norm, double tolerance) const override {
-            if (std::isnan(tolerance) || tolerance < 0) {
+        RESULT_CODE radiusQuery(IVector const* pSample, IVector::NORM norm, double radius, Visitor& visitor) const override {
+            if (std::isnan(radius) || radius < 0) {
                 if (pLogger != nullptr) {
-                    pLogger->log("in SetImpl::get: NAN tolerance", RESULT_CODE::NAN_VALUE);
+                    pLogger->log("in ConcurrentSet::radiusQuery: NAN radius", RESULT_CODE::NAN_VALUE);
                 }
                 return RESULT_CODE::NAN_VALUE;
             }
 
             if (pSample == nullptr) {
                 if (pLogger != nullptr) {
-                    pLogger->log("in SetImpl::get: null param", RESULT_CODE::BAD_REFERENCE);
+                    pLogger->log("in ConcurrentSet::radiusQuery: null param", RESULT_CODE::BAD_REFERENCE);
                 }
                 return RESULT_CODE::BAD_REFERENCE;
             }
 
-            if (pSample->getDim() != getDim()) {
+            auto locks = lockAll();
+            if (order.empty()) { return RESULT_CODE::SUCCESS; }
+            if (pSample->getDim() != dim.load()) {
                 if (pLogger != nullptr) {
-                    pLogger->log("in SetImpl::get", RESULT_CODE::WRONG_DIM);
+                    pLogger->log("in ConcurrentSet::radiusQuery", RESULT_CODE::WRONG_DIM);
                 }
                 return RESULT_CODE::WRONG_DIM;
             }
 
-            IVector *diff = nullptr;
+            auto point = coordsOf(pSample);
+            std::vector<double> box(2 * point.size());
+            for (size_t i = 0; i < point.size(); i++) {
+                box[i] = point[i] - radius;
+                box[point.size() + i] = point[i] + radius;
+            }
+            return visitSorted(box.data(), box.data() + point.size(), visitor, [&](double const* coords) {
+                return distance(point.data(), coords, point.size(), norm) <= radius;
+            });
+        }
 
-            for (auto elem: elements) {
-                diff = IVector::sub(pSample, elem, pLogger);
-                if (diff == nullptr) {
-                    if (pLogger != nullptr) {
-                        pLogger->log("in SetImpl::get: nullptr", RESULT_CODE::BAD_REFERENCE);
-                    }
-                    return RESULT_CODE::BAD_REFERENCE;
-                }
+        RESULT_CODE countInBox(ICompact const* pBox, size_t& count) const override {
+            count = 0;
+            struct Counter: Visitor {
+                size_t count = 0;
+                bool visit(size_t, double const*) override { count++; return true; }
+            } counter;
+            auto rc = queryBox(pBox, counter);
+            count = counter.count;
+            return rc;
+        }
 
-                if (diff->norm(norm) < tolerance) {
-                    delete diff;
+        RESULT_CODE queryBox(ICompact const* pBox, Visitor& visitor) const override {
+            std::vector<double> box;
+            auto rc = boundsOf(pBox, box, "queryBox");
+            if (rc != RESULT_CODE::SUCCESS || box.empty()) { return rc; }
 
-                    auto cloneElem = elem->clone();
-                    if (cloneElem == nullptr) {
-                        if (pLogger != nullptr) {
-                            pLogger->log("in SetImpl::get: nullptr", RESULT_CODE::BAD_REFERENCE);
-                        }
-                        return RESULT_CODE::BAD_REFERENCE;
-                    }
+            auto locks = lockAll();
+            return visitSorted(box.data(), box.data() + box.size() / 2, visitor, [](double const*) { return true; });
+        }
+
+        RESULT_CODE eraseInBox(ICompact const* pBox, size_t& erased) override {
+            erased = 0;
+            std::vector<double> box;
+            auto rc = boundsOf(pBox, box, "eraseInBox");
+            if (rc != RESULT_CODE::SUCCESS || box.empty()) { return rc; }
+
+            auto locks = lockAll();
+            std::vector<size_t> found;
+            for (auto const& shard: shards) {
+                shard->index.query(shard->elements, box.data(), box.data() + box.size() / 2, [&](size_t local, double const*) {
+                    found.push_back(shard->ids[local]);
+                });
+            }
+            std::sort(found.begin(), found.end());
+            eraseSorted(found);
+            erased = found.size();
+            return RESULT_CODE::SUCCESS;
+        }
+
+        RESULT_CODE eraseIf(Visitor& predicate, size_t& erased) override {
+            auto locks = lockAll();
+            std::vector<size_t> marked;
+            for (size_t k = 0; k < order.size(); k++) {
+                if (predicate.visit(k, shards[order[k].first]->elements.point(order[k].second))) { marked.push_back(k); }
+            }
+            eraseSorted(marked);
+            erased = marked.size();
+            return RESULT_CODE::SUCCESS;
+        }
 
-                    pVector = cloneElem;
-                    return RESULT_CODE::SUCCESS;
+        // as a hashed set of the same cells, which is what ISet::open gives back
+        RESULT_CODE save(char const* path) const override {
+            SetImpl<GridIndex> copy(pLogger, GridIndex(cell));
+            {
+                auto locks = lockAll();
+                size_t dim = this->dim.load();
+                std::vector<double> coords;
+                coords.reserve(order.size() * dim);
+                for (auto const& at: order) {
+                    double const* point = shards[at.first]->elements.point(at.second);
+                    coords.insert(coords.end(), point, point + dim);
                 }
-                delete diff;
+
+                // the elements are distinct already, nothing is closer than zero
+                std::vector<RESULT_CODE> results(order.size(), RESULT_CODE::SUCCESS);
+                copy.insertPoints(coords.data(), order.size(), dim, IVector::NORM::NORM_INF, 0, results.data());
             }
+            return copy.save(path);
+        }
 
-            if (pLogger != nullptr) {
-                pLogger->log("in SetImpl::get", RESULT_CODE::NOT_FOUND);
+    private:
+        static const size_t shardCount = 64;
+
+        struct Shard {
+            explicit Shard(double cell): index(cell) {}
+
+            std::mutex lock;
+            Storage elements;
+            GridIndex index;
+            // global index of every point of the shard, increasing as the points are unless shuffled by swapErase
+            std::vector<size_t> ids;
+            bool shuffled = false;
+
+            // local index of the point closer than <tolerance> to <point> of the smallest global index, none if there is none
+            size_t find(double const* point, IVector::NORM norm, double tolerance) const {
+                if (elements.getSize() == 0) { return none; }
+                size_t dim = elements.getDim(), found = none;
+                std::vector<double> box(2 * dim);
+                for (size_t i = 0; i < dim; i++) {
+                    box[i] = point[i] - tolerance;
+                    box[dim + i] = point[i] + tolerance;
+                }
+                index.query(elements, box.data(), box.data() + dim, [&](size_t id, double const* coords) {
+                    if ((found == none || ids[id] < ids[found]) && distance(point, coords, dim, norm) < tolerance) { found = id; }
+                });
+                return found;
             }
-            return RESULT_CODE::NOT_FOUND;
+        };
+
+        double cell;
+        ILogger* pLogger;
+        std::vector<std::unique_ptr<Shard>> shards;
+        std::atomic<size_t> dim{0};
+        // (shard, local index) of every element by its global index, appended under orderLock
+        mutable std::mutex orderLock;
+        std::vector<std::pair<size_t, size_t>> order;
+
+        typedef std::vector<std::pair<size_t, std::unique_lock<std::mutex>>> Locks;
+
+        // WRONG_DIM or MULTIPLE_DEFINITION without logging them, <pVector> is not null
+        RESULT_CODE tryInsert(const IVector* pVector, IVector::NORM norm, double tolerance) {
+            // the first insert fixes the dimension, concurrent ones agree on it
+            size_t expected = 0;
+            dim.compare_exchange_strong(expected, pVector->getDim());
+            if (pVector->getDim() != dim.load()) { return RESULT_CODE::WRONG_DIM; }
+
+            auto point = coordsOf(pVector);
+            auto locks = lockAround(point.data(), tolerance);
+            for (auto const& locked: locks) {
+                if (shards[locked.first]->find(point.data(), norm, tolerance) != none) { return RESULT_CODE::MULTIPLE_DEFINITION; }
+            }
+
+            // the cell of the point is in its box, so its shard is locked
+            size_t homeShard = shardOf(point.data());
+            Shard& home = *shards[homeShard];
+            if (home.elements.getSize() == 0) {
+                home.elements.reset(point.size());
+                home.index.reset(point.size());
+            }
+            home.elements.push(point.data());
+            home.index.insert(home.elements, home.elements.getSize() - 1, 1);
+
+            std::lock_guard<std::mutex> guard(orderLock);
+            home.ids.push_back(order.size());
+            order.push_back(std::make_pair(homeShard, home.elements.getSize() - 1));
+            return RESULT_CODE::SUCCESS;
         }
 
-        //space dimension
-        size_t getDim() const override {
-            if (elements.empty()) { return 0; }
-            return elements[0]->getDim();
+        size_t shardOf(double const* point) const {
+            return hashPointCell(point, dim.load(), cell) & (shardCount - 1);
         }
 
-        //num elements in set
-        size_t getSize() const override { return elements.size(); }
+        // locks the shards of the cells of the box point +- tolerance in increasing order, all of them for a wide box
+        Locks lockAround(double const* point, double tolerance) const {
+            size_t dim = this->dim.load();
+            std::vector<long long> from(dim), to(dim), at(dim);
+            double cells = 1;
+            for (size_t i = 0; i < dim; i++) {
+                from[i] = cellIndex(point[i] - tolerance, cell);
+                to[i] = cellIndex(point[i] + tolerance, cell);
+                cells *= static_cast<double>(to[i] - from[i] + 1);
+            }
 
-        void clear() override {
-            for (auto &elem: elements) {
-                delete elem;
+            std::vector<bool> touched(shardCount, cells > shardCount);
+            if (cells <= shardCount) {
+                at = from;
+                while (true) {
+                    touched[hashCell(at.data(), dim) & (shardCount - 1)] = true;
+                    size_t i = 0;
+                    while (i < dim && at[i] == to[i]) {
+                        at[i] = from[i];
+                        i++;
+                    }
+                    if (i == dim) { break; }
+                    at[i]++;
+                }
             }
-            elements.clear();
+
+            Locks locks;
+            for (size_t k = 0; k < shardCount; k++) {
+                if (touched[k]) { locks.emplace_back(k, std::unique_lock<std::mutex>(shards[k]->lock)); }
+            }
+            return locks;
         }
 
-        RESULT_CODE erase(size_t index) override {
-            if (index >= elements.size()) {
-                if (pLogger != nullptr) {
-                    pLogger->log("ISet::erase", RESULT_CODE::OUT_OF_BOUNDS);
+        /* locks the shard of element <index> into <shardLock> and gives its place, false past the end.
+           An erase may move the element between reading the order and locking the shard,
+           so the order is read again under the shard lock until both agree */
+        bool lockElement(size_t index, std::pair<size_t, size_t>& at, std::unique_lock<std::mutex>& shardLock) const {
+            while (true) {
+                {
+                    std::lock_guard<std::mutex> guard(orderLock);
+                    if (index >= order.size()) { return false; }
+                    at = order[index];
+                }
+
+                std::unique_lock<std::mutex> locked(shards[at.first]->lock);
+                std::lock_guard<std::mutex> guard(orderLock);
+                if (index < order.size() && order[index] == at) {
+                    shardLock = std::move(locked);
+                    return true;
                 }
-                return RESULT_CODE::OUT_OF_BOUNDS;
             }
+        }
+
+        // every shard, then the order
+        Locks lockAll() const {
+            Locks locks;
+            for (size_t k = 0; k < shardCount; k++) { locks.emplace_back(k, std::unique_lock<std::mutex>(shards[k]->lock)); }
+            locks.emplace_back(shardCount, std::unique_lock<std::mutex>(orderLock));
+            return locks;
+        }
 
-            auto elem = elements.begin() + index;
-            if (*elem != nullptr) { delete *elem; }
-            elements.erase(elem);
+        // visits in index order the elements of the box [lo, hi] that pass <keep>, the whole set is locked
+        template<class Keep>
+        RESULT_CODE visitSorted(double const* lo, double const* hi, Visitor& visitor, Keep keep) const {
+            std::vector<std::pair<size_t, double const*>> found;
+            for (auto const& shard: shards) {
+                shard->index.query(shard->elements, lo, hi, [&](size_t local, double const* coords) {
+                    if (keep(coords)) { found.push_back(std::make_pair(shard->ids[local], coords)); }
+                });
+            }
+            std::sort(found.begin(), found.end());
+            for (auto const& element: found) {
+                if (!visitor.visit(element.first, element.second)) { break; }
+            }
             return RESULT_CODE::SUCCESS;
         }
 
-        RESULT_CODE erase(IVector const* pSample, IVector::NORM norm, double tolerance) override {
-            if (std::isnan(tolerance) || tolerance < 0) {
+        // [begin, end] of <pBox> as lo then hi, empty for an empty set
+        RESULT_CODE boundsOf(ICompact const* pBox, std::vector<double>& box, char const* method) const {
+            if (pBox == nullptr) {
                 if (pLogger != nullptr) {
-                    pLogger->log("In ISet::erase: nullptr", RESULT_CODE::BAD_REFERENCE);
+                    pLogger->log((std::string("in ConcurrentSet::") + method + ": null param").c_str(), RESULT_CODE::BAD_REFERENCE);
                 }
                 return RESULT_CODE::BAD_REFERENCE;
             }
+            if (getSize() == 0) { return RESULT_CODE::SUCCESS; }
 
-            IVector *diff = nullptr;
-            size_t i = 0;
-            for (auto elem: elements) {
-                diff = IVector::sub(pSample, elem, pLogger);
-                if (diff == nullptr) { break; }
-                if (diff->norm(norm) < tolerance) {
-                    delete diff;
-                    delete *(elements.begin() + i);
-                    elements.erase(elements.begin() + i);
-                    return RESULT_CODE::SUCCESS;
+            if (pBox->getDim() != getDim()) {
+                if (pLogger != nullptr) {
+                    pLogger->log((std::string("in ConcurrentSet::") + method).c_str(), RESULT_CODE::WRONG_DIM);
                 }
-                delete diff;
-                i++;
-            }
-            if (pLogger != nullptr) {
-                pLogger->log("In Set::erase", RESULT_CODE::NOT_FOUND);
+                return RESULT_CODE::WRONG_DIM;
             }
-            return RESULT_CODE::NOT_FOUND;
-        }
 
-        ISet* clone() const override {
-            SetImpl *set = new (std::nothrow) SetImpl(pLogger);
-            if (set == nullptr) {
+            std::unique_ptr<IVector> begin(pBox->getBegin()), end(pBox->getEnd());
+            if (begin == nullptr || end == nullptr) {
                 if (pLogger != nullptr) {
-                    pLogger->log("in ISet::clone: out of memory", RESULT_CODE::OUT_OF_MEMORY);
+                    pLogger->log((std::string("in ConcurrentSet::") + method + ": no box bounds").c_str(), RESULT_CODE::BAD_REFERENCE);
                 }
-                return nullptr;
+                return RESULT_CODE::BAD_REFERENCE;
             }
+            box = coordsOf(begin.get());
+            auto hi = coordsOf(end.get());
+            box.insert(box.end(), hi.begin(), hi.end());
+            return RESULT_CODE::SUCCESS;
+        }
 
-            auto n = elements.size();
-            set->elements.resize(n);
+        // the smallest global index of a point closer than <tolerance> to <point>, none if there is none; the whole set is locked
+        size_t findLocked(double const* point, IVector::NORM norm, double tolerance) const {
+            size_t found = none;
+            for (auto const& shard: shards) {
+                size_t local = shard->find(point, norm, tolerance);
+                if (local != none) { found = std::min(found, shard->ids[local]); }
+            }
+            return found;
+        }
 
-            for (size_t i = 0; i < n; i++) {
-                auto cloneElem = elements[i]->clone();
+        /* the last element takes global index <index> and the last point of the shard of <index> takes its place there,
+           so one list of the shard index and two entries of the order change; the whole set is locked */
+        void swapEraseLocked(size_t index) {
+            Shard& shard = *shards[order[index].first];
+            size_t local = order[index].second, localLast = shard.elements.getSize() - 1;
+            shard.index.swapErase(shard.elements, local, shard.elements.point(local), localLast, shard.elements.point(localLast));
+            shard.elements.swapErase(local);
+            shard.ids[local] = shard.ids[localLast];
+            shard.ids.pop_back();
+            if (local != localLast) {
+                order[shard.ids[local]].second = local;
+                shard.shuffled = true;
+            }
 
-                if (cloneElem == nullptr) {
-                    if (pLogger != nullptr) {
-                        pLogger->log("in ISet::clone: out of memory", RESULT_CODE::OUT_OF_MEMORY);
+            size_t last = order.size() - 1;
+            if (index != last) {
+                order[index] = order[last];
+                Shard& moved = *shards[order[index].first];
+                moved.ids[order[index].second] = index;
+                moved.shuffled = true;
+            }
+            order.pop_back();
+        }
+
+        /* drops the elements of <ids>, given in increasing order, from the shards that hold them in place:
+           the rest keep their order and shards, their global and local indices shift down; the whole set is locked */
+        void eraseSorted(std::vector<size_t> const& ids) {
+            if (ids.empty()) { return; }
+            // erased local indices of every shard, in increasing order
+            std::vector<std::vector<size_t>> erased(shards.size());
+            for (auto id: ids) { erased[order[id].first].push_back(order[id].second); }
+
+            for (size_t s = 0; s < shards.size(); s++) {
+                auto &locals = erased[s];
+                if (locals.empty()) { continue; }
+                // swapErase leaves the local order of a shard apart from the global one
+                std::sort(locals.begin(), locals.end());
+                Shard& shard = *shards[s];
+                shard.index.eraseShift(shard.elements, locals);
+                shard.elements.erase(locals);
+                size_t kept = locals.front(), next = 0;
+                for (size_t k = kept; k < shard.ids.size(); k++) {
+                    if (next < locals.size() && locals[next] == k) {
+                        next++;
+                        continue;
                     }
+                    shard.ids[kept++] = shard.ids[k];
+                }
+                shard.ids.resize(kept);
+            }
 
-                    set->elements.resize(i);
-                    delete set;
-                    return nullptr;
+            auto shifted = [](size_t id, std::vector<size_t> const& gone) {
+                return id - (std::lower_bound(gone.begin(), gone.end(), id) - gone.begin());
+            };
+            for (auto &shard: shards) {
+                for (auto &id: shard->ids) { id = shifted(id, ids); }
+            }
+            // a shuffled shard may shift the local index of an element before the first erased one
+            size_t kept = 0, next = 0;
+            for (size_t k = 0; k < order.size(); k++) {
+                if (next < ids.size() && ids[next] == k) {
+                    next++;
+                    continue;
                 }
-                set->elements[i] = cloneElem;
+                order[kept] = order[k];
+                order[kept].second = shifted(order[k].second, erased[order[k].first]);
+                kept++;
             }
-            return set;
+            order.resize(kept);
+        }
+
+        static std::vector<double> coordsOf(IVector const* pVector) {
+            std::vector<double> coords(pVector->getDim());
+            for (size_t i = 0; i < coords.size(); i++) { coords[i] = pVector->getCoord(i); }
+            return coords;
+        }
+
+        RESULT_CODE makeVector(IVector*& pVector, double const* coords) const {
+            auto cloneElem = IVector::createVector(dim.load(), const_cast<double*>(coords), pLogger);
+            if (cloneElem == nullptr) {
+                if (pLogger != nullptr) {
+                    pLogger->log("in ConcurrentSet::get: nullptr", RESULT_CODE::BAD_REFERENCE);
+                }
+                return RESULT_CODE::BAD_REFERENCE;
+            }
+            pVector = cloneElem;
+            return RESULT_CODE::SUCCESS;
         }
+
+        ConcurrentSet(ConcurrentSet const& set) = delete;
+        ConcurrentSet& operator=(ConcurrentSet const& set) = delete;
     };
+
+    const size_t ConcurrentSet::shardCount;
 }
 
 ISet::~ISet() {}
 
 ISet* ISet::createSet(ILogger* pLogger) {
-    ISet* set = new (std::nothrow) SetImpl(pLogger);
+    ISet* set = new (std::nothrow) SetImpl<KdIndex>(pLogger, KdIndex());
     if (set == nullptr) {
         pLogger->log("in ISet::createSet", RESULT_CODE::OUT_OF_MEMORY);
     }
     return set;
 }
 
+ISet* ISet::createSet(ILogger* pLogger, IVector::NORM norm, double tolerance) {
+    if (std::isnan(tolerance) || tolerance <= 0 || std::isinf(tolerance)) {
+        if (pLogger != nullptr) {
+            pLogger->log("in ISet::createSet: tolerance should be positive", RESULT_CODE::WRONG_ARGUMENT);
+        }
+        return nullptr;
+    }
+
+    if (norm != IVector::NORM::NORM_1 && norm != IVector::NORM::NORM_2 && norm != IVector::NORM::NORM_INF) {
+        if (pLogger != nullptr) {
+            pLogger->log("in ISet::createSet: unknown norm", RESULT_CODE::WRONG_ARGUMENT);
+        }
+        return nullptr;
+    }
+
+    // every norm bounds the coordinate differences, so a match lies in the box sample +- tolerance,
+    // which overlaps at most two cells per axis when they are twice as wide as the tolerance
+    ISet* set = new (std::nothrow) SetImpl<GridIndex>(pLogger, GridIndex(2 * tolerance));
+    if (set == nullptr && pLogger != nullptr) {
+        pLogger->log("in ISet::createSet", RESULT_CODE::OUT_OF_MEMORY);
+    }
+    return set;
+}
+
+ISet* ISet::createConcurrentSet(ILogger* pLogger, IVector::NORM norm, double tolerance) {
+    if (std::isnan(tolerance) || tolerance <= 0 || std::isinf(tolerance)) {
+        if (pLogger != nullptr) {
+            pLogger->log("in ISet::createConcurrentSet: tolerance should be positive", RESULT_CODE::WRONG_ARGUMENT);
+        }
+        return nullptr;
+    }
+
+    if (norm != IVector::NORM::NORM_1 && norm != IVector::NORM::NORM_2 && norm != IVector::NORM::NORM_INF) {
+        if (pLogger != nullptr) {
+            pLogger->log("in ISet::createConcurrentSet: unknown norm", RESULT_CODE::WRONG_ARGUMENT);
+        }
+        return nullptr;
+    }
+
+    ISet* set = new (std::nothrow) ConcurrentSet(pLogger, 2 * tolerance);
+    if (set == nullptr && pLogger != nullptr) {
+        pLogger->log("in ISet::createConcurrentSet", RESULT_CODE::OUT_OF_MEMORY);
+    }
+    return set;
+}
+
+namespace {
+    // the set of the rest of <file> with <spatialIndex> as its empty index, nullptr if the file does not describe one
+    template<class Index>
+    static ISet* load(FileReader& file, SetFileHeader const& header, Index const& spatialIndex, ILogger* pLogger) {
+        SetImpl<Index> *set = new (std::nothrow) SetImpl<Index>(pLogger, spatialIndex);
+        if (set == nullptr) {
+            if (pLogger != nullptr) {
+                pLogger->log("in ISet::open", RESULT_CODE::OUT_OF_MEMORY);
+            }
+            return nullptr;
+        }
+
+        if (!set->load(file, static_cast<size_t>(header.dim)) || set->getSize() != header.count) {
+            if (pLogger != nullptr) {
+                pLogger->log("in ISet::open: broken file", RESULT_CODE::FILE_ERROR);
+            }
+            delete set;
+            return nullptr;
+        }
+        return set;
+    }
+}
+
+ISet* ISet::open(char const* path, ILogger* pLogger) {
+    if (path == nullptr) {
+        if (pLogger != nullptr) {
+            pLogger->log("in ISet::open: null param", RESULT_CODE::BAD_REFERENCE);
+        }
+        return nullptr;
+    }
+
+    auto mapped = MappedFile::open(path);
+    if (mapped == nullptr) {
+        if (pLogger != nullptr) {
+            pLogger->log("in ISet::open: cannot map file", RESULT_CODE::FILE_ERROR);
+        }
+        return nullptr;
+    }
+
+    FileReader file(mapped);
+    SetFileHeader header;
+    if (!file.read(&header, sizeof(header)) || header.magic != SetFileHeader::signature
+        || header.version != SetFileHeader::currentVersion || header.wordSize != sizeof(size_t)) {
+        if (pLogger != nullptr) {
+            pLogger->log("in ISet::open: not a set file", RESULT_CODE::FILE_ERROR);
+        }
+        return nullptr;
+    }
+
+    switch (header.kind) {
+    case SetFileHeader::KD_INDEX:
+        return load(file, header, KdIndex(), pLogger);
+    case SetFileHeader::GRID_INDEX:
+        if (header.cell > 0 && !std::isinf(header.cell)) { return load(file, header, GridIndex(header.cell), pLogger); }
+        break;
+    }
+
+    if (pLogger != nullptr) {
+        pLogger->log("in ISet::open: unknown index", RESULT_CODE::FILE_ERROR);
+    }
+    return nullptr;
+}
+
+namespace {
+    // <set> itself when it is a SetImpl, otherwise a copy of it made into <copy>; nullptr if the copy fails
+    static SetBase const* asSetBase(ISet const* set, std::unique_ptr<ISet>& copy, ILogger* pLogger) {
+        auto own = dynamic_cast<SetBase const*>(set);
+        if (own != nullptr) { return own; }
+
+        copy.reset(ISet::createSet(pLogger));
+        auto result = dynamic_cast<SetBase*>(copy.get());
+        if (result == nullptr) { return nullptr; }
+
+        // one forEach reads a concurrent set under its locks, so the copy is a snapshot of it
+        size_t dim = set->getDim(), count = set->getSize();
+        std::vector<double> coords;
+        coords.reserve(count * dim);
+        set->forEach([&](size_t, double const* point) {
+            coords.insert(coords.end(), point, point + dim);
+            return true;
+        });
+        count = dim != 0 ? coords.size() / dim : 0;
+
+        // elements of a set are distinct already, nothing is closer than zero
+        std::vector<RESULT_CODE> results(count, RESULT_CODE::SUCCESS);
+        result->insertPoints(coords.data(), count, dim, IVector::NORM::NORM_INF, 0, results.data());
+        return result;
+    }
+
+    // inserts into <set> the elements of <points> with results[k] == SUCCESS in their order, gathered into one buffer
+    static void insertSelected(SetBase* set, Storage const& points, std::vector<RESULT_CODE> const& results,
+                               IVector::NORM norm, double tolerance) {
+        size_t dim = points.getDim();
+        std::vector<double> coords;
+        for (size_t k = 0; k < results.size(); k++) {
+            if (results[k] == RESULT_CODE::SUCCESS) { coords.insert(coords.end(), points.point(k), points.point(k) + dim); }
+        }
+
+        size_t count = dim != 0 ? coords.size() / dim : 0;
+        std::vector<RESULT_CODE> accepted(count, RESULT_CODE::SUCCESS);
+        set->insertPoints(coords.data(), count, dim, norm, tolerance, accepted.data());
+    }
+
+    /* spatial join: SUCCESS for the elements of <from> that have a match in <in> if <matched> or that have none otherwise,
+       NOT_FOUND for the rest; every element is looked up in the index of <in> in parallel */
+    static std::vector<RESULT_CODE> selectByMatch(SetBase const* from, SetBase const* in, bool matched,
+                                                  IVector::NORM norm, double tolerance) {
+        Storage const& points = from->getElements();
+        std::vector<RESULT_CODE> results(from->getSize());
+        bool isEmpty = in->getSize() == 0;
+
+        parallelFor(results.size(), 1024, [&](size_t first, size_t last) {
+            for (size_t k = first; k < last; k++) {
+                bool found = !isEmpty && in->find(points.point(k), norm, tolerance) != none;
+                results[k] = found == matched ? RESULT_CODE::SUCCESS : RESULT_CODE::NOT_FOUND;
+            }
+        });
+        return results;
+    }
+}
+
 ISet* ISet::add(ISet const* pOperand1, ISet const* pOperand2, IVector::NORM norm, double tolerance, ILogger* pLogger) {
     if (std::isnan(tolerance) || tolerance < 0) {
         if (pLogger != nullptr) {
@@ -274,21 +2645,15 @@ ISet* ISet::add(ISet const* pOperand1, ISet const* pOperand2, IVector::NORM norm
         return nullptr;
     }
 
-    ISet *sum = pOperand1->clone();
+    std::unique_ptr<ISet> copy1, copy2;
+    SetBase const *base1 = asSetBase(pOperand1, copy1, pLogger), *base2 = asSetBase(pOperand2, copy2, pLogger);
+    if (base1 == nullptr || base2 == nullptr) { return nullptr; }
 
+    // the elements of the second operand go into a copy of the first as inserts one by one would
+    auto sum = dynamic_cast<SetBase*>(base1->clone());
     if (sum != nullptr) {
-        IVector *elem2;
-
-        for (size_t i = 0; i < pOperand2->getSize(); i++) {
-            if (pOperand2->get(elem2, i) != RESULT_CODE::SUCCESS) {
-                delete sum;
-                sum = nullptr;
-                break;
-            }
-
-            sum->insert(elem2, norm, tolerance);
-            delete elem2;
-        }
+        Storage const& points = base2->getElements();
+        insertSelected(sum, points, std::vector<RESULT_CODE>(points.getSize(), RESULT_CODE::SUCCESS), norm, tolerance);
     }
 
     return sum;
@@ -316,36 +2681,22 @@ ISet* ISet::intersect(ISet const* pOperand1, ISet const* pOperand2, IVector::NOR
         return nullptr;
     }
 
+    std::unique_ptr<ISet> copy1, copy2;
+    SetBase const *base1 = asSetBase(pOperand1, copy1, pLogger), *base2 = asSetBase(pOperand2, copy2, pLogger);
+    auto intersection = dynamic_cast<SetBase*>(ISet::createSet(pLogger));
 
-    ISet *intersection = ISet::createSet(pLogger);
-
-    if (intersection == nullptr) {
+    if (base1 == nullptr || base2 == nullptr || intersection == nullptr) {
+        delete intersection;
         if (pLogger != nullptr) {
             pLogger->log("in ISet::intersect", RESULT_CODE::BAD_REFERENCE);
         }
         return nullptr;
     }
 
-    IVector *elem, *elemFound;
-    for (size_t i = 0; i < pOperand2->getSize(); i++) {
-        if (pOperand2->get(elem, i) != RESULT_CODE::SUCCESS) {
-            delete intersection;
-            intersection = nullptr;
-            break;
-        }
-
-        auto rc = pOperand1->get(elemFound, elem, norm, tolerance);
-        if (rc == RESULT_CODE::SUCCESS) {
-            intersection->insert(elem, norm, tolerance);
-            delete elemFound;
-        } else if (rc != RESULT_CODE::NOT_FOUND) {
-            delete elem;
-            delete intersection;
-            intersection = nullptr;
-            break;
-        }
-        delete elem;
-    }
+    // the elements of the second operand with a match in the first, in the order of the second
+    Storage const& points = base2->getElements();
+    auto results = selectByMatch(base2, base1, true, norm, tolerance);
+    insertSelected(intersection, points, results, norm, tolerance);
 
     return intersection;
 }
@@ -365,38 +2716,31 @@ ISet* ISet::sub(ISet const* pOperand1, ISet const* pOperand2, IVector::NORM norm
         return nullptr;
     }
 
-    ISet *diff = ISet::createSet(pLogger);
-
-    if (diff == nullptr) {
+    // an empty operand goes with any dimension
+    if (pOperand1->getSize() != 0 && pOperand2->getSize() != 0 && pOperand1->getDim() != pOperand2->getDim()) {
         if (pLogger != nullptr) {
-            pLogger->log("in ISet::sub", RESULT_CODE::BAD_REFERENCE);
+            pLogger->log("in ISet::sub: dim mismatch", RESULT_CODE::WRONG_DIM);
         }
         return nullptr;
     }
 
-    IVector *elem, *elemFound;
-    for (size_t i = 0; i < pOperand1->getSize(); i++) {
-        pOperand1->get(elem, i);
-        if (pOperand1->get(elem, i) != RESULT_CODE::SUCCESS) {
-            delete diff;
-            diff = nullptr;
-            break;
-        }
+    std::unique_ptr<ISet> copy1, copy2;
+    SetBase const *base1 = asSetBase(pOperand1, copy1, pLogger), *base2 = asSetBase(pOperand2, copy2, pLogger);
+    auto diff = dynamic_cast<SetBase*>(ISet::createSet(pLogger));
 
-        auto rc = pOperand2->get(elemFound, elem, norm, tolerance);
-        if (rc == RESULT_CODE::NOT_FOUND) {
-            diff->insert(elem, norm, tolerance);
-        } else if (rc != RESULT_CODE::SUCCESS) {
-            delete elem;
-            delete diff;
-            diff = nullptr;
-            break;
-        } else {
-            delete elemFound;
+    if (base1 == nullptr || base2 == nullptr || diff == nullptr) {
+        delete diff;
+        if (pLogger != nullptr) {
+            pLogger->log("in ISet::sub", RESULT_CODE::BAD_REFERENCE);
         }
-        delete elem;
+        return nullptr;
     }
 
+    // the elements of the first operand without a match in the second, in the order of the first
+    Storage const& points = base1->getElements();
+    auto results = selectByMatch(base1, base2, false, norm, tolerance);
+    insertSelected(diff, points, results, norm, tolerance);
+
     return diff;
 }
 
@@ -408,33 +2752,57 @@ ISet* ISet::symSub(ISet const* pOperand1, ISet const* pOperand2, IVector::NORM n
         return nullptr;
     }
 
-    ISet *unified = ISet::add(pOperand1, pOperand2, norm, tolerance, pLogger);
-    if (unified == nullptr) {
+    if (pOperand1 == nullptr || pOperand2 == nullptr) {
         if (pLogger != nullptr) {
-            pLogger->log("in ISet::symSub", RESULT_CODE::BAD_REFERENCE);
+            pLogger->log("in ISet::symSub: null operand", RESULT_CODE::BAD_REFERENCE);
         }
         return nullptr;
     }
 
-    ISet *intersection = ISet::intersect(pOperand1, pOperand2, norm, tolerance, pLogger);
-    if (intersection == nullptr) {
-        delete unified;
+    // an empty operand goes with any dimension
+    if (pOperand1->getSize() != 0 && pOperand2->getSize() != 0 && pOperand1->getDim() != pOperand2->getDim()) {
         if (pLogger != nullptr) {
-            pLogger->log("in ISet::symSub", RESULT_CODE::BAD_REFERENCE);
+            pLogger->log("in ISet::symSub: dim mismatch", RESULT_CODE::WRONG_DIM);
         }
         return nullptr;
     }
 
-    auto symsub = ISet::sub(unified, intersection, norm, tolerance, pLogger);
+    std::unique_ptr<ISet> copy1, copy2;
+    SetBase const *base1 = asSetBase(pOperand1, copy1, pLogger), *base2 = asSetBase(pOperand2, copy2, pLogger);
+    auto symsub = dynamic_cast<SetBase*>(ISet::createSet(pLogger));
 
-    delete unified;
-    delete intersection;
-
-    if (symsub == nullptr) {
+    if (base1 == nullptr || base2 == nullptr || symsub == nullptr) {
+        delete symsub;
         if (pLogger != nullptr) {
             pLogger->log("in ISet::symSub", RESULT_CODE::BAD_REFERENCE);
         }
         return nullptr;
     }
+
+    /* one join: every element of the first operand collects all its matches in the second,
+       which marks the matched elements of both sides, as the distance is symmetric */
+    Storage const &points1 = base1->getElements(), &points2 = base2->getElements();
+    std::vector<RESULT_CODE> only1(points1.getSize()), only2(points2.getSize(), RESULT_CODE::SUCCESS);
+    std::vector<std::atomic<bool>> matched2(points2.getSize());
+    for (auto &flag: matched2) { flag.store(false, std::memory_order_relaxed); }
+    bool isEmpty2 = points2.getSize() == 0;
+
+    parallelFor(only1.size(), 1024, [&](size_t first, size_t last) {
+        std::vector<size_t> found;
+        for (size_t k = first; k < last; k++) {
+            found.clear();
+            if (!isEmpty2) { base2->findAll(points1.point(k), norm, tolerance, found); }
+            only1[k] = found.empty() ? RESULT_CODE::SUCCESS : RESULT_CODE::NOT_FOUND;
+            for (auto j: found) { matched2[j].store(true, std::memory_order_relaxed); }
+        }
+    });
+    for (size_t j = 0; j < only2.size(); j++) {
+        if (matched2[j].load(std::memory_order_relaxed)) { only2[j] = RESULT_CODE::NOT_FOUND; }
+    }
+
+    // the unmatched elements of the first operand in its order, then those of the second
+    insertSelected(symsub, points1, only1, norm, tolerance);
+    insertSelected(symsub, points2, only2, norm, tolerance);
+
     return symsub;
 }
@@ -0,0 +1,245 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "include/ILogger.h"
+#include "include/IVector.h"
+#include "include/ISet.h"
+
+/* scaling of ISet: every operation is timed on sets of 1e3, 1e4, ... up to maxSize uniform random points,
+ * for the default and the hashed set, several dimensions, norms and tolerances. Prints JSON:
+ *
+ *     set_bench [maxSize [output.json]]
+ *
+ * "results" has the time of every operation at every size, "growth" the exponent of its time per call between
+ * consecutive sizes: about 0 for a constant cost, 0.1 for log n, 1 for a linear one; one more than 0.5 above
+ * the expected exponent of the operation is flagged "superLinear" */
+
+using namespace std;
+
+// log n and cache misses of a working set outgrowing the caches stay below 0.5 between sizes ten times apart,
+// a cost per call growing like the square root of n is 0.5; only times long enough to be above the timer noise are flagged
+static const double superLinearExponent = 0.5, minFlaggedMs = 2;
+
+struct Config {
+    bool hashed;
+    size_t dim;
+    IVector::NORM norm;
+    // "fine" keeps every point, "spacing" is half the mean distance between points and rejects some
+    bool coarse;
+};
+
+struct Result {
+    Config config;
+    string op;
+    size_t n, count;
+    double ms;
+};
+
+static char const* normName(IVector::NORM norm) {
+    switch (norm) {
+    case IVector::NORM::NORM_1:
+        return "NORM_1";
+    case IVector::NORM::NORM_2:
+        return "NORM_2";
+    default:
+        return "NORM_INF";
+    }
+}
+
+class Timer {
+public:
+    Timer(): start(chrono::steady_clock::now()) {}
+
+    double ms() const { return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count(); }
+
+private:
+    chrono::steady_clock::time_point start;
+};
+
+// <count> points uniform in [0, 1]^dim
+static vector<IVector*> randomPoints(size_t count, size_t dim, unsigned long long seed) {
+    vector<IVector*> points(count);
+    vector<double> coords(dim);
+    unsigned long long state = seed;
+    for (size_t n = 0; n < count; ++n) {
+        for (size_t i = 0; i < dim; ++i) {
+            state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+            coords[i] = static_cast<double>(state >> 11) / 9007199254740992.0;
+        }
+        points[n] = IVector::createVector(dim, coords.data(), nullptr);
+    }
+    return points;
+}
+
+static void destroy(vector<IVector*>& points) {
+    for (auto point: points) { delete point; }
+    points.clear();
+}
+
+static ISet* createSet(Config const& config, double tolerance) {
+    return config.hashed ? ISet::createSet(nullptr, config.norm, tolerance) : ISet::createSet(nullptr);
+}
+
+// every operation at one size; the second operand of the set algebra shares half of its points with the first
+static void measure(Config const& config, size_t n, vector<Result>& results) {
+    double tolerance = config.coarse ? 0.5 * pow(static_cast<double>(n), -1.0 / config.dim) : 1e-9;
+    vector<IVector*> points = randomPoints(n, config.dim, 1 + n), others = randomPoints(n / 2, config.dim, 2 + n);
+    auto record = [&](char const* op, size_t count, double ms) {
+        Result result = {config, op, n, count, ms};
+        results.push_back(result);
+    };
+
+    ISet *s = createSet(config, tolerance), *operand = createSet(config, tolerance);
+    if (s == nullptr || operand == nullptr) {
+        delete s;
+        delete operand;
+        destroy(points);
+        destroy(others);
+        return;
+    }
+
+    Timer insertTimer;
+    for (auto point: points) { s->insert(point, config.norm, tolerance); }
+    record("insert", n, insertTimer.ms());
+
+    size_t size = s->getSize();
+    Timer getTimer;
+    for (size_t k = 0; k < size; ++k) {
+        IVector* elem = nullptr;
+        s->get(elem, k);
+        delete elem;
+    }
+    record("getByIndex", size, getTimer.ms());
+
+    Timer sampleTimer;
+    for (auto point: points) {
+        IVector* elem = nullptr;
+        s->get(elem, point, config.norm, tolerance);
+        delete elem;
+    }
+    record("getBySample", n, sampleTimer.ms());
+
+    for (size_t k = 0; k < n; k += 2) { operand->insert(points[k], config.norm, tolerance); }
+    for (auto point: others) { operand->insert(point, config.norm, tolerance); }
+
+    typedef ISet* (*Operation)(ISet const*, ISet const*, IVector::NORM, double, ILogger*);
+    const pair<char const*, Operation> operations[] = {
+        make_pair("add", &ISet::add), make_pair("intersect", &ISet::intersect),
+        make_pair("sub", &ISet::sub), make_pair("symSub", &ISet::symSub)
+    };
+    for (auto const& operation: operations) {
+        Timer timer;
+        ISet* result = operation.second(s, operand, config.norm, tolerance, nullptr);
+        record(operation.first, n, timer.ms());
+        delete result;
+    }
+
+    Timer cloneTimer;
+    ISet* copy = s->clone();
+    record("clone", 1, cloneTimer.ms());
+
+    // a hundredth of the elements, spread over the set
+    size_t erased = max<size_t>(size / 100, 1);
+    Timer eraseTimer;
+    for (size_t k = 0; k < erased && s->getSize() != 0; ++k) { s->erase((k * 7919) % s->getSize()); }
+    record("erase", erased, eraseTimer.ms());
+
+    if (copy != nullptr) {
+        Timer swapTimer;
+        for (size_t k = 0; k < erased && copy->getSize() != 0; ++k) { copy->swapErase((k * 7919) % copy->getSize()); }
+        record("swapErase", erased, swapTimer.ms());
+    }
+
+    delete copy;
+    delete s;
+    delete operand;
+    destroy(points);
+    destroy(others);
+}
+
+static void printConfig(FILE* out, Config const& config) {
+    fprintf(out, "\"set\": \"%s\", \"dim\": %zu, \"norm\": \"%s\", \"tolerance\": \"%s\"", config.hashed ? "hashed" : "default",
+            config.dim, normName(config.norm), config.coarse ? "spacing" : "fine");
+}
+
+// an ordered erase shifts the indices of all later elements, a clone copies the whole set: both are linear per call
+static double expectedExponent(string const& op) {
+    return op == "erase" || op == "clone" ? 1 : 0;
+}
+
+static void printJson(FILE* out, vector<size_t> const& sizes, vector<Result> const& results) {
+    fprintf(out, "{\n  \"sizes\": [");
+    for (size_t k = 0; k < sizes.size(); ++k) { fprintf(out, "%s%zu", k == 0 ? "" : ", ", sizes[k]); }
+    fprintf(out, "],\n  \"results\": [");
+    for (size_t k = 0; k < results.size(); ++k) {
+        Result const& result = results[k];
+        fprintf(out, "%s\n    {", k == 0 ? "" : ",");
+        printConfig(out, result.config);
+        fprintf(out, ", \"op\": \"%s\", \"n\": %zu, \"count\": %zu, \"ms\": %.4f, \"nsPerOp\": %.1f}", result.op.c_str(), result.n,
+                result.count, result.ms, result.count != 0 ? result.ms * 1e6 / result.count : 0.0);
+    }
+
+    // every result against the next size of the same configuration and operation
+    fprintf(out, "\n  ],\n  \"growth\": [");
+    bool first = true;
+    size_t flagged = 0;
+    for (size_t k = 0; k + 1 < results.size(); ++k) {
+        Result const &from = results[k];
+        auto to = find_if(results.begin() + k + 1, results.end(), [&](Result const& r) {
+            return r.op == from.op && r.n > from.n && r.config.hashed == from.config.hashed && r.config.dim == from.config.dim
+                   && r.config.norm == from.config.norm && r.config.coarse == from.config.coarse;
+        });
+        if (to == results.end()) { continue; }
+
+        // the count of calls may grow with the size too, the time per call does not
+        double fromPerOp = from.ms / max<size_t>(from.count, 1), toPerOp = to->ms / max<size_t>(to->count, 1);
+        double exponent = fromPerOp > 0 && toPerOp > 0 ? log(toPerOp / fromPerOp) / log(static_cast<double>(to->n) / from.n) : 0;
+        bool superLinear = exponent > expectedExponent(from.op) + superLinearExponent && to->ms >= minFlaggedMs;
+        flagged += superLinear;
+        fprintf(out, "%s\n    {", first ? "" : ",");
+        printConfig(out, from.config);
+        fprintf(out, ", \"op\": \"%s\", \"from\": %zu, \"to\": %zu, \"exponent\": %.3f, \"superLinear\": %s}", from.op.c_str(), from.n,
+                to->n, exponent, superLinear ? "true" : "false");
+        first = false;
+    }
+    fprintf(out, "\n  ],\n  \"superLinear\": %zu\n}\n", flagged);
+}
+
+int main(int argc, char** argv) {
+    size_t maxSize = argc > 1 ? strtoull(argv[1], nullptr, 10) : 100000;
+    FILE* out = argc > 2 ? fopen(argv[2], "w") : stdout;
+    if (maxSize == 0 || out == nullptr) {
+        fprintf(stderr, "usage: set_bench [maxSize [output.json]]\n");
+        return 1;
+    }
+
+    vector<size_t> sizes;
+    for (size_t n = 1000; n <= maxSize; n *= 10) { sizes.push_back(n); }
+
+    const size_t dims[] = {2, 8};
+    const IVector::NORM norms[] = {IVector::NORM::NORM_1, IVector::NORM::NORM_2, IVector::NORM::NORM_INF};
+    vector<Result> results;
+    for (bool hashed: {false, true}) {
+        for (size_t dim: dims) {
+            for (IVector::NORM norm: norms) {
+                for (bool coarse: {false, true}) {
+                    Config config = {hashed, dim, norm, coarse};
+                    for (size_t n: sizes) {
+                        fprintf(stderr, "%s dim %zu %s %s n %zu\n", hashed ? "hashed" : "default", dim, normName(norm),
+                                coarse ? "spacing" : "fine", n);
+                        measure(config, n, results);
+                    }
+                }
+            }
+        }
+    }
+
+    printJson(out, sizes, results);
+    if (out != stdout) { fclose(out); }
+    return 0;
+}
@@ -1,5 +1,5 @@
 TEMPLATE = app
-CONFIG += console c++11
+CONFIG += console c++11 thread
 CONFIG -= app_bundle
 CONFIG -= qt
 
@@ -12,14 +12,17 @@ HEADERS += \
     include/RC.h \
     include/ILogger.h \
     include/IVector.h \
+    include/ICompact.h \
     include/ISet.h
 
 LIBS += \
     -L$$PWD/libs/ -llogger \
     -L$$PWD/libs/ -lvector \
+    -L$$PWD/libs/ -lcompact \
     -L$$PWD/libs/ -lset
 
 DISTFILES += \
     libs/logger.dll \
     libs/vector.dll \
+    libs/compact.dll \
     libs/set.dll
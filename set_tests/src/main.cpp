@@ -2,11 +2,16 @@
 #include <cmath>
 #include <array>
 #include <cassert>
+#include <vector>
+#include <algorithm>
+#include <thread>
+#include <atomic>
 
 #include "include/test.h"
 #include "include/ILogger.h"
 #include "include/IVector.h"
 #include "include/ISet.h"
+#include "include/ICompact.h"
 
 #define CLIENT(n) ((void*) n)
 #define CLIENT_KEY 47
@@ -172,6 +177,24 @@ bool isEmpty(size_t size) {
     return size == 0;
 }
 
+static bool isTrue(bool expression) {
+    return expression == true;
+}
+
+// <count> points uniform in [0, 1)^dim, the same ones for the same seed
+template<size_t dim = DIMENSION>
+static vector<array<double, dim>> randomPoints(size_t count, unsigned long long seed) {
+    vector<array<double, dim>> points(count);
+    unsigned long long state = seed;
+    for (auto &point: points) {
+        for (size_t i = 0; i < dim; ++i) {
+            state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+            point[i] = static_cast<double>(state >> 11) / 9007199254740992.0;
+        }
+    }
+    return points;
+}
+
 static void testSum(ISet* s1, ISet* s2, ILogger* pLogger) {
     assert(s1 && s2);
 
@@ -228,6 +251,8 @@ static void testDiff(ISet* s1, ISet* s2, ILogger* pLogger) {
     auto
             goodDiff = ISet::sub(s1, s2, IVector::NORM::NORM_2, TOLERANCE, pLogger),
             goodDiff_empty = ISet::sub(s1, s1, IVector::NORM::NORM_2, TOLERANCE, pLogger),
+            emptySet = ISet::createSet(pLogger),
+            goodDiff_emptyRight = ISet::sub(s1, emptySet, IVector::NORM::NORM_2, TOLERANCE, pLogger),
             badDiff_nan = ISet::sub(s1, s2, IVector::NORM::NORM_2, NAN, static_cast<ILogger*>(nullptr)),
             badDiff_nullptr_right = ISet::sub(s1, nullptr, IVector::NORM::NORM_2, TOLERANCE, static_cast<ILogger*>(nullptr)),
             badDiff_nullptr_left = ISet::sub(nullptr, s2, IVector::NORM::NORM_2, TOLERANCE, static_cast<ILogger*>(nullptr));
@@ -242,6 +267,10 @@ static void testDiff(ISet* s1, ISet* s2, ILogger* pLogger) {
         delete goodDiff_empty;
     }
 
+    test("Difference of set and empty set", isTrue, goodDiff_emptyRight != nullptr && checkSet(goodDiff_emptyRight, setData1));
+    delete goodDiff_emptyRight;
+    delete emptySet;
+
     test("Difference with nan tolerance", isBad<ISet>, badDiff_nan);
     test("Difference of set and null", isBad<ISet>, badDiff_nullptr_right);
     test("Difference of null and set", isBad<ISet>, badDiff_nullptr_left);
@@ -253,6 +282,8 @@ static void testSymDiff(ISet* s1, ISet* s2, ILogger* pLogger) {
     auto
             goodSymDiff = ISet::symSub(s1, s2, IVector::NORM::NORM_2, TOLERANCE, nullptr),
             goodSymDiff_empty = ISet::symSub(s1, s1, IVector::NORM::NORM_2, TOLERANCE, pLogger),
+            emptySet = ISet::createSet(pLogger),
+            goodSymDiff_emptyLeft = ISet::symSub(emptySet, s2, IVector::NORM::NORM_2, TOLERANCE, pLogger),
             badSymDiff_nan = ISet::symSub(s1, s2, IVector::NORM::NORM_2, NAN, static_cast<ILogger*>(nullptr)),
             badSymDiff_nullptr_right = ISet::symSub(s1, nullptr, IVector::NORM::NORM_2, TOLERANCE, static_cast<ILogger*>(nullptr)),
             badSymDiff_nullptr_left = ISet::symSub(nullptr, s2, IVector::NORM::NORM_2, TOLERANCE, static_cast<ILogger*>(nullptr));
@@ -267,15 +298,15 @@ static void testSymDiff(ISet* s1, ISet* s2, ILogger* pLogger) {
         delete goodSymDiff_empty;
     }
 
+    test("Sym difference of empty set and set", isTrue, goodSymDiff_emptyLeft != nullptr && checkSet(goodSymDiff_emptyLeft, setData2));
+    delete goodSymDiff_emptyLeft;
+    delete emptySet;
+
     test("Sym difference with nan tolerance", isBad<ISet>, badSymDiff_nan);
     test("Sym difference of set and null", isBad<ISet>, badSymDiff_nullptr_right);
     test("Sym difference of null and set", isBad<ISet>, badSymDiff_nullptr_left);
 }
 
-static bool isTrue(bool expression) {
-    return expression == true;
-}
-
 static bool testClone(ISet* s) {
     assert(s);
 
@@ -290,6 +321,53 @@ static bool testClone(ISet* s) {
     return res;
 }
 
+// a clone and its set share elements until either changes, then each sees only its own changes
+static void testCloneChanges(ILogger* pLogger, bool hashed) {
+    const size_t count = 5000;
+    const double tolerance = 0.001;
+    const IVector::NORM norm = IVector::NORM::NORM_2;
+    ISet* s = hashed ? ISet::createSet(pLogger, norm, tolerance) : ISet::createSet(pLogger);
+    if (s == nullptr) { return; }
+
+    auto drawn = randomPoints(count + 1, 5);
+    vector<IVector*> points(count + 1);
+    for (size_t n = 0; n <= count; ++n) {
+        points[n] = IVector::createVector(DIMENSION, drawn[n].data(), pLogger);
+        if (n < count) { s->insert(points[n], norm, tolerance); }
+    }
+
+    auto snapshot = [](ISet* set) {
+        vector<double> coords;
+        set->forEach([&](size_t, double const* point) {
+            coords.insert(coords.end(), point, point + DIMENSION);
+            return true;
+        });
+        return coords;
+    };
+    auto found = [&](ISet* set, IVector* sample) {
+        IVector* elem = nullptr;
+        bool result = set->get(elem, sample, norm, tolerance) == RESULT_CODE::SUCCESS;
+        delete elem;
+        return result;
+    };
+
+    auto before = snapshot(s);
+    ISet* copy = s->clone();
+    bool ok = copy != nullptr && snapshot(copy) == before
+              && copy->insert(points[count], norm, tolerance) == RESULT_CODE::SUCCESS
+              && copy->erase(points[10], norm, tolerance) == RESULT_CODE::SUCCESS && copy->erase(copy->getSize() - 1) == RESULT_CODE::SUCCESS
+              && snapshot(s) == before && !found(s, points[count]) && found(s, points[10]) && found(copy, points[20]);
+
+    auto changed = copy != nullptr ? snapshot(copy) : before;
+    ok = ok && s->erase(static_cast<size_t>(0)) == RESULT_CODE::SUCCESS && s->insert(points[count], norm, tolerance) == RESULT_CODE::SUCCESS
+         && snapshot(copy) == changed && found(copy, points[0]) && !found(copy, points[10]) && found(s, points[count]);
+    test(hashed ? "Clone of a hashed set changed apart" : "Clone changed apart", isTrue, ok);
+
+    delete copy;
+    delete s;
+    for (auto point: points) { delete point; }
+}
+
 static void testInsert(ILogger* pLogger) {
     ISet* s = ISet::createSet(nullptr);
 
@@ -356,6 +434,580 @@ static void testErase(ISet* s, ILogger* pLogger) {
     }
 }
 
+// lookups on a set large enough to need its spatial index, hashed by grid cells or not
+static void testIndex(ILogger* pLogger, bool hashed) {
+    const size_t side = 40;
+    const IVector::NORM norms[] = {IVector::NORM::NORM_1, IVector::NORM::NORM_2, IVector::NORM::NORM_INF};
+
+    for (auto norm: norms) {
+        ISet* s = hashed ? ISet::createSet(pLogger, norm, 0.05) : ISet::createSet(pLogger);
+        if (s == nullptr) { return; }
+
+        bool ok = true;
+        double coords[DIMENSION];
+        for (size_t i = 0; i < side * side && ok; ++i) {
+            coords[0] = 0.1 * (i % side);
+            coords[1] = 0.1 * (i / side);
+            IVector* vec = IVector::createVector(DIMENSION, coords, pLogger);
+            ok = vec != nullptr && s->insert(vec, norm, 0.05) == RESULT_CODE::SUCCESS;
+            delete vec;
+        }
+
+        // shifted copies are within tolerance of exactly one element
+        size_t duplicates = 0, found = 0;
+        for (size_t i = 0; i < side * side && ok; ++i) {
+            coords[0] = 0.1 * (i % side) + 0.01;
+            coords[1] = 0.1 * (i / side) - 0.01;
+            IVector *vec = IVector::createVector(DIMENSION, coords, pLogger), *elem = nullptr;
+            duplicates += s->insert(vec, norm, 0.05) == RESULT_CODE::MULTIPLE_DEFINITION;
+            if (s->get(elem, vec, norm, 0.05) == RESULT_CODE::SUCCESS) {
+                found += abs(elem->getCoord(0) - 0.1 * (i % side)) < TOLERANCE && abs(elem->getCoord(1) - 0.1 * (i / side)) < TOLERANCE;
+                delete elem;
+            }
+            delete vec;
+        }
+        test(hashed ? "Lookups in a large hashed set" : "Lookups in a large set", isTrue, ok && duplicates == side * side && found == side * side);
+
+        // erasing every other element keeps the rest reachable by index and by sample
+        for (size_t i = 0; i < side * side / 2; ++i) { s->erase(i); }
+        bool consistent = s->getSize() == side * side / 2;
+        for (size_t i = 0; i < s->getSize() && consistent; ++i) {
+            IVector *elem = nullptr, *same = nullptr;
+            consistent = s->get(elem, i) == RESULT_CODE::SUCCESS
+                         && s->get(same, elem, norm, 0.05) == RESULT_CODE::SUCCESS
+                         && abs(same->getCoord(0) - elem->getCoord(0)) < TOLERANCE && abs(same->getCoord(1) - elem->getCoord(1)) < TOLERANCE;
+            delete elem;
+            delete same;
+        }
+        coords[0] = coords[1] = 0;
+        IVector* erased = IVector::createVector(DIMENSION, coords, pLogger);
+        IVector* elem = nullptr;
+        consistent = consistent && s->get(elem, erased, norm, 0.05) == RESULT_CODE::NOT_FOUND;
+        delete erased;
+        test(hashed ? "Lookups in a large hashed set after erase" : "Lookups in a large set after erase", isTrue, consistent);
+
+        delete s;
+    }
+}
+
+// borrowed walks see the same elements as get, in the same order
+static void testForEach(ISet* s) {
+    size_t visited = 0;
+    bool same = true;
+    s->forEach([&](size_t index, double const* coords) {
+        IVector* elem = nullptr;
+        same = same && index == visited && s->get(elem, index) == RESULT_CODE::SUCCESS
+               && elem->getCoord(0) == coords[0] && elem->getCoord(1) == coords[1];
+        delete elem;
+        visited++;
+        return true;
+    });
+    test("Walk over set elements", isTrue, same && visited == s->getSize());
+
+    visited = 0;
+    s->forEach([&](size_t, double const*) { return ++visited < 2; });
+    test("Walk over set elements stopped early", isTrue, visited == 2);
+
+    double const* coords = nullptr;
+    size_t spanned = 0;
+    for (size_t first = 0, count; (count = s->getSpan(first, coords)) != 0; first += count) {
+        for (size_t k = 0; k < count; ++k) {
+            IVector* elem = nullptr;
+            same = same && s->get(elem, first + k) == RESULT_CODE::SUCCESS
+                   && elem->getCoord(0) == coords[k * DIMENSION] && elem->getCoord(1) == coords[k * DIMENSION + 1];
+            delete elem;
+        }
+        spanned += count;
+    }
+    test("Spans of set elements", isTrue, same && spanned == s->getSize());
+}
+
+// nearest neighbours and radius queries agree with a scan of all elements
+static void testNeighbours(ILogger* pLogger, bool hashed) {
+    const size_t count = 2000, k = 7;
+    const double radius = 0.05;
+    const IVector::NORM norms[] = {IVector::NORM::NORM_1, IVector::NORM::NORM_2, IVector::NORM::NORM_INF};
+
+    for (auto norm: norms) {
+        ISet* s = hashed ? ISet::createSet(pLogger, norm, 0.01) : ISet::createSet(pLogger);
+        if (s == nullptr) { return; }
+
+        for (auto &point: randomPoints(count, 777)) {
+            IVector* vec = IVector::createVector(DIMENSION, point.data(), pLogger);
+            s->insert(vec, norm, 1e-9);
+            delete vec;
+        }
+
+        double coords[DIMENSION];
+        bool nearestOk = true, radiusOk = true;
+        for (size_t q = 0; q < 50 && nearestOk && radiusOk; ++q) {
+            // samples also fall outside the cloud of points
+            coords[0] = -0.5 + 0.04 * q;
+            coords[1] = 0.3 + 0.01 * q;
+            IVector* sample = IVector::createVector(DIMENSION, coords, pLogger);
+
+            vector<pair<double, size_t>> all;
+            s->forEach([&](size_t index, double const* point) {
+                IVector* elem = IVector::createVector(DIMENSION, const_cast<double*>(point), pLogger);
+                IVector* diff = IVector::sub(elem, sample, pLogger);
+                all.push_back(make_pair(diff->norm(norm), index));
+                delete diff;
+                delete elem;
+                return true;
+            });
+            sort(all.begin(), all.end());
+
+            size_t indices[k], found = 0;
+            nearestOk = s->knn(sample, norm, k, indices, found) == RESULT_CODE::SUCCESS && found == k;
+            for (size_t n = 0; n < found && nearestOk; ++n) { nearestOk = indices[n] == all[n].second; }
+
+            vector<size_t> inside, expected;
+            radiusOk = s->radiusQuery(sample, norm, radius, [&](size_t index, double const*) {
+                inside.push_back(index);
+                return true;
+            }) == RESULT_CODE::SUCCESS;
+            for (auto const& neighbour: all) {
+                if (neighbour.first <= radius) { expected.push_back(neighbour.second); }
+            }
+            sort(expected.begin(), expected.end());
+            radiusOk = radiusOk && inside == expected;
+
+            delete sample;
+        }
+        test(hashed ? "Nearest neighbours in a hashed set" : "Nearest neighbours", isTrue, nearestOk);
+        test(hashed ? "Radius query in a hashed set" : "Radius query", isTrue, radiusOk);
+
+        size_t indices[count + 1], found = 0;
+        IVector* sample = IVector::createVector(DIMENSION, coords, pLogger);
+        test("Nearest neighbours beyond the size", isTrue, s->knn(sample, norm, count + 1, indices, found) == RESULT_CODE::SUCCESS && found == count);
+        delete sample;
+        delete s;
+    }
+}
+
+// box queries agree with a check of every element, erasing a box keeps the order of the rest
+static void testBox(ILogger* pLogger, bool hashed) {
+    const size_t count = 2000;
+    ISet* s = hashed ? ISet::createSet(pLogger, IVector::NORM::NORM_2, 0.01) : ISet::createSet(pLogger);
+    double lo[DIMENSION] = {0.2, 0.1}, hi[DIMENSION] = {0.5, 0.7}, wideLo[DIMENSION + 1] = {0.2, 0.1, 0}, wide[DIMENSION + 1] = {1, 1, 1};
+    IVector *begin = IVector::createVector(DIMENSION, lo, pLogger), *end = IVector::createVector(DIMENSION, hi, pLogger),
+            *wideBegin = IVector::createVector(DIMENSION + 1, wideLo, pLogger), *wideEnd = IVector::createVector(DIMENSION + 1, wide, pLogger);
+    ICompact *box = ICompact::createCompact(begin, end, pLogger), *wideBox = ICompact::createCompact(wideBegin, wideEnd, pLogger);
+    auto release = [&]() {
+        delete box;
+        delete wideBox;
+        delete begin;
+        delete end;
+        delete wideBegin;
+        delete wideEnd;
+        delete s;
+    };
+    if (s == nullptr || box == nullptr || wideBox == nullptr) {
+        release();
+        return;
+    }
+
+    vector<array<double, DIMENSION>> points, outside, drawn = randomPoints(count, 99);
+    vector<size_t> expected;
+    for (size_t n = 0; n < count; ++n) {
+        array<double, DIMENSION> point = drawn[n];
+        // some points on the boundary
+        if (n % 50 == 0) { point[0] = lo[0]; }
+        IVector* vec = IVector::createVector(DIMENSION, point.data(), pLogger);
+        if (s->insert(vec, IVector::NORM::NORM_2, 1e-9) == RESULT_CODE::SUCCESS) {
+            bool inside = lo[0] <= point[0] && point[0] <= hi[0] && lo[1] <= point[1] && point[1] <= hi[1];
+            if (inside) {
+                expected.push_back(points.size());
+            } else {
+                outside.push_back(point);
+            }
+            points.push_back(point);
+        }
+        delete vec;
+    }
+
+    size_t inBox = 0;
+    vector<size_t> visited;
+    bool ok = s->countInBox(box, inBox) == RESULT_CODE::SUCCESS && inBox == expected.size() && inBox != 0;
+    ok = ok && s->queryBox(box, [&](size_t index, double const* coords) {
+        visited.push_back(index);
+        return coords[0] == points[index][0] && coords[1] == points[index][1];
+    }) == RESULT_CODE::SUCCESS && visited == expected;
+    test(hashed ? "Box query in a hashed set" : "Box query", isTrue, ok);
+
+    size_t erased = 0;
+    ok = s->eraseInBox(box, erased) == RESULT_CODE::SUCCESS && erased == expected.size() && s->getSize() == outside.size();
+    for (size_t n = 0; n < s->getSize() && ok; ++n) {
+        IVector *elem = nullptr, *same = nullptr;
+        ok = s->get(elem, n) == RESULT_CODE::SUCCESS && elem->getCoord(0) == outside[n][0] && elem->getCoord(1) == outside[n][1]
+             && s->get(same, elem, IVector::NORM::NORM_2, 1e-9) == RESULT_CODE::SUCCESS;
+        delete elem;
+        delete same;
+    }
+    ok = ok && s->countInBox(box, inBox) == RESULT_CODE::SUCCESS && inBox == 0;
+    test(hashed ? "Box erase in a hashed set" : "Box erase", isTrue, ok);
+
+    test("Box query of another dimension", isTrue, s->countInBox(wideBox, inBox) == RESULT_CODE::WRONG_DIM);
+    test("Box query of null", isTrue, s->countInBox(nullptr, inBox) == RESULT_CODE::BAD_REFERENCE);
+
+    release();
+}
+
+// a concurrent set behaves as a hashed one for a single thread, several threads keep its elements distinct
+static void testConcurrent(ILogger* pLogger) {
+    const size_t count = 3000, threads = 4, k = 5;
+    const double tolerance = 0.02;
+    const IVector::NORM norm = IVector::NORM::NORM_2;
+
+    auto drawn = randomPoints(count, 31);
+    vector<IVector*> points(count);
+    for (size_t n = 0; n < count; ++n) { points[n] = IVector::createVector(DIMENSION, drawn[n].data(), pLogger); }
+
+    ISet *hashed = ISet::createSet(pLogger, norm, tolerance), *shared = ISet::createConcurrentSet(pLogger, norm, tolerance);
+    bool same = hashed != nullptr && shared != nullptr;
+    for (size_t n = 0; n < count && same; ++n) {
+        same = hashed->insert(points[n], norm, tolerance) == shared->insert(points[n], norm, tolerance);
+    }
+    same = same && hashed->getSize() == shared->getSize();
+    for (size_t n = 0; n < count && same; n += 7) {
+        IVector *one = nullptr, *other = nullptr;
+        same = hashed->get(one, points[n], norm, tolerance) == RESULT_CODE::SUCCESS
+               && shared->get(other, points[n], norm, tolerance) == RESULT_CODE::SUCCESS
+               && one->getCoord(0) == other->getCoord(0) && one->getCoord(1) == other->getCoord(1);
+        delete one;
+        delete other;
+
+        size_t near1[k], near2[k], found1 = 0, found2 = 0;
+        hashed->knn(points[n], norm, k, near1, found1);
+        shared->knn(points[n], norm, k, near2, found2);
+        same = same && found1 == found2 && equal(near1, near1 + found1, near2);
+    }
+    test("Concurrent set in one thread", isTrue, same);
+    delete hashed;
+    delete shared;
+
+    // every thread inserts all the points in its own order
+    shared = ISet::createConcurrentSet(pLogger, norm, tolerance);
+    if (shared == nullptr) { return; }
+    vector<thread> workers;
+    for (size_t t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t]() {
+            for (size_t n = 0; n < count; ++n) { shared->insert(points[(n * (2 * t + 1) + t * 101) % count], norm, tolerance); }
+        });
+    }
+    for (auto &worker: workers) { worker.join(); }
+
+    bool distinct = true, covered = true;
+    for (size_t n = 0; n < shared->getSize() && distinct; ++n) {
+        IVector* elem = nullptr;
+        size_t near[2], found = 0;
+        distinct = shared->get(elem, n) == RESULT_CODE::SUCCESS && shared->knn(elem, norm, 2, near, found) == RESULT_CODE::SUCCESS;
+        if (distinct && found == 2) {
+            IVector *other = nullptr, *diff = nullptr;
+            shared->get(other, near[1]);
+            diff = IVector::sub(elem, other, pLogger);
+            distinct = diff->norm(norm) >= tolerance;
+            delete diff;
+            delete other;
+        }
+        delete elem;
+    }
+    for (size_t n = 0; n < count && covered; ++n) {
+        IVector* elem = nullptr;
+        covered = shared->get(elem, points[n], norm, tolerance) == RESULT_CODE::SUCCESS;
+        delete elem;
+    }
+    test("Concurrent inserts keep elements distinct", isTrue, distinct && covered);
+
+    // reads by index while another thread erases: every one finds an element or the end of the set,
+    // the coordinates of a span are those of an inserted point
+    auto sorted = drawn;
+    sort(sorted.begin(), sorted.end());
+    atomic<bool> done(false);
+    bool consistent = true;
+    thread eraser([&]() {
+        while (shared->getSize() > count / 4) {
+            shared->swapErase(0);
+            shared->erase(shared->getSize() / 2);
+            this_thread::yield();
+        }
+        done = true;
+    });
+    for (size_t n = 0; !done; ++n) {
+        IVector* elem = nullptr;
+        double const* coords = nullptr;
+        auto rc = shared->get(elem, n % count);
+        consistent = consistent && (rc == RESULT_CODE::SUCCESS || rc == RESULT_CODE::OUT_OF_BOUNDS);
+        consistent = consistent && (shared->getSpan(n % count, coords) == 0
+                                    || binary_search(sorted.begin(), sorted.end(), array<double, DIMENSION>{{coords[0], coords[1]}}));
+        delete elem;
+    }
+    eraser.join();
+    test("Concurrent reads by index during erases", isTrue, consistent);
+
+    test("Concurrent set with zero tolerance", isBad<ISet>, ISet::createConcurrentSet(pLogger, norm, 0));
+    delete shared;
+    for (auto point: points) { delete point; }
+}
+
+// a bulk insert matches the same inserts one by one: statuses, elements and their order
+static void testBulk(ILogger* pLogger, bool hashed) {
+    const size_t count = 4000;
+    const double tolerance = 0.02;
+    const IVector::NORM norms[] = {IVector::NORM::NORM_1, IVector::NORM::NORM_2, IVector::NORM::NORM_INF};
+
+    for (auto norm: norms) {
+        ISet *single = hashed ? ISet::createSet(pLogger, norm, tolerance) : ISet::createSet(pLogger),
+             *bulk = hashed ? ISet::createSet(pLogger, norm, tolerance) : ISet::createSet(pLogger);
+        vector<IVector*> points(count, nullptr);
+        auto drawn = randomPoints<DIMENSION + 1>(count, 12345);
+        for (size_t k = 0; k < count; ++k) {
+            // chains of close points, some null and some of another dimension
+            if (k % 7 == 1) {
+                drawn[k][0] = drawn[k - 1][0] + 0.6 * tolerance;
+                drawn[k][1] = drawn[k - 1][1];
+            }
+            if (k % 97 != 5) { points[k] = IVector::createVector(k % 101 == 3 ? DIMENSION + 1 : DIMENSION, drawn[k].data(), pLogger); }
+        }
+
+        // half goes in one by one into both, the other half in one batch into one of them
+        bool ok = single != nullptr && bulk != nullptr;
+        for (size_t k = 0; k < count / 2 && ok; ++k) {
+            ok = single->insert(points[k], norm, tolerance) == bulk->insert(points[k], norm, tolerance);
+        }
+        vector<RESULT_CODE> status(count / 2);
+        ok = ok && bulk->insertBulk(points.data() + count / 2, count / 2, norm, tolerance, status.data()) == RESULT_CODE::SUCCESS;
+        size_t rejected = 0;
+        for (size_t k = count / 2; k < count && ok; ++k) {
+            ok = single->insert(points[k], norm, tolerance) == status[k - count / 2];
+            rejected += status[k - count / 2] == RESULT_CODE::MULTIPLE_DEFINITION;
+        }
+
+        ok = ok && rejected != 0 && single->getSize() == bulk->getSize();
+        for (size_t k = 0; ok && k < single->getSize(); ++k) {
+            IVector *one = nullptr, *other = nullptr;
+            ok = single->get(one, k) == RESULT_CODE::SUCCESS && bulk->get(other, k) == RESULT_CODE::SUCCESS
+                 && one->getCoord(0) == other->getCoord(0) && one->getCoord(1) == other->getCoord(1);
+            delete one;
+            delete other;
+        }
+        test(hashed ? "Bulk insert into a hashed set" : "Bulk insert", isTrue, ok);
+
+        for (auto point: points) { delete point; }
+        delete single;
+        delete bulk;
+    }
+
+    ISet* s = ISet::createSet(pLogger);
+    test("Bulk insert with nan tolerance", isTrue, s != nullptr && s->insertBulk(nullptr, 0, IVector::NORM::NORM_2, NAN, nullptr) == RESULT_CODE::NAN_VALUE);
+    delete s;
+}
+
+// a set opened from its file has the same elements and lookups, and changing it leaves the file as it was
+static void testSave(ILogger* pLogger) {
+    const size_t count = 3000, k = 4;
+    const double tolerance = 0.01;
+    const IVector::NORM norm = IVector::NORM::NORM_2;
+    const char *path = "set_tests_set.bin";
+
+    for (int kind = 0; kind < 3; ++kind) {
+        ISet *s = kind == 0 ? ISet::createSet(pLogger)
+                : kind == 1 ? ISet::createSet(pLogger, norm, tolerance) : ISet::createConcurrentSet(pLogger, norm, tolerance);
+        if (s == nullptr) { return; }
+
+        auto drawn = randomPoints(count, 77);
+        vector<IVector*> points(count);
+        for (size_t n = 0; n < count; ++n) {
+            points[n] = IVector::createVector(DIMENSION, drawn[n].data(), pLogger);
+            s->insert(points[n], norm, tolerance);
+        }
+        // erased elements leave tombstones in the k-d index
+        for (size_t n = 0; n < 20; ++n) { s->erase(n * 7); }
+
+        ISet *opened = s->save(path) == RESULT_CODE::SUCCESS ? ISet::open(path, pLogger) : nullptr;
+        bool ok = opened != nullptr && opened->getSize() == s->getSize() && opened->getDim() == s->getDim();
+        double const *coords = nullptr;
+        for (size_t first = 0, spanned; ok && (spanned = opened->getSpan(first, coords)) != 0; first += spanned) {
+            for (size_t n = 0; ok && n < spanned; ++n) {
+                IVector *elem = nullptr;
+                ok = s->get(elem, first + n) == RESULT_CODE::SUCCESS
+                     && elem->getCoord(0) == coords[n * DIMENSION] && elem->getCoord(1) == coords[n * DIMENSION + 1];
+                delete elem;
+            }
+        }
+        for (size_t n = 0; ok && n < count; n += 5) {
+            IVector *one = nullptr, *other = nullptr;
+            auto rc = s->get(one, points[n], norm, tolerance);
+            ok = opened->get(other, points[n], norm, tolerance) == rc
+                 && (rc != RESULT_CODE::SUCCESS || (one->getCoord(0) == other->getCoord(0) && one->getCoord(1) == other->getCoord(1)));
+            delete one;
+            delete other;
+
+            size_t near1[k], near2[k], found1 = 0, found2 = 0;
+            s->knn(points[n], norm, k, near1, found1);
+            opened->knn(points[n], norm, k, near2, found2);
+            ok = ok && found1 == found2 && equal(near1, near1 + found1, near2);
+        }
+        test(kind == 0 ? "Saved set reopened" : kind == 1 ? "Saved hashed set reopened" : "Saved concurrent set reopened", isTrue, ok);
+
+        // an opened set copies what it changes
+        size_t size = s->getSize();
+        ok = opened != nullptr && opened->erase(points[1], norm, tolerance) == RESULT_CODE::SUCCESS
+             && opened->insert(points[1], norm, tolerance) == RESULT_CODE::SUCCESS
+             && opened->insert(points[1], norm, tolerance) == RESULT_CODE::MULTIPLE_DEFINITION
+             && opened->erase(size - 1) == RESULT_CODE::SUCCESS && opened->getSize() == size - 1;
+        delete opened;
+        opened = ISet::open(path, pLogger);
+        ok = ok && opened != nullptr && opened->getSize() == size;
+        test("Opened set changed apart from its file", isTrue, ok);
+
+        delete opened;
+        delete s;
+        for (auto point: points) { delete point; }
+    }
+
+    FILE *file = fopen(path, "wb");
+    if (file != nullptr) {
+        fputs("not a set", file);
+        fclose(file);
+    }
+    test("Open of a file of another kind", isBad<ISet>, ISet::open(path, pLogger));
+    remove(path);
+    test("Open of a missing file", isBad<ISet>, ISet::open(path, pLogger));
+}
+
+// lookups of a hashed set miss exactly the erased points, their cells are dropped from its filter and come back on insert
+static void testMisses(ILogger* pLogger) {
+    const size_t count = 2000;
+    const double tolerance = 1e-4;
+    const IVector::NORM norm = IVector::NORM::NORM_INF;
+    ISet* s = ISet::createSet(pLogger, norm, tolerance);
+    if (s == nullptr) { return; }
+
+    auto drawn = randomPoints(count, 3);
+    vector<IVector*> points(count);
+    for (size_t n = 0; n < count; ++n) {
+        points[n] = IVector::createVector(DIMENSION, drawn[n].data(), pLogger);
+        s->insert(points[n], norm, tolerance);
+    }
+
+    bool ok = s->getSize() == count;
+    for (size_t n = 0; n < count && ok; n += 2) { ok = s->erase(points[n], norm, tolerance) == RESULT_CODE::SUCCESS; }
+    for (size_t n = 0; n < count && ok; ++n) {
+        IVector* elem = nullptr;
+        auto rc = s->get(elem, points[n], norm, tolerance);
+        ok = n % 2 == 0 ? rc == RESULT_CODE::NOT_FOUND && s->erase(points[n], norm, tolerance) == RESULT_CODE::NOT_FOUND
+                        : rc == RESULT_CODE::SUCCESS;
+        delete elem;
+    }
+    for (size_t n = 0; n < count && ok; n += 2) { ok = s->insert(points[n], norm, tolerance) == RESULT_CODE::SUCCESS; }
+    for (size_t n = 0; n < count && ok; ++n) {
+        IVector* elem = nullptr;
+        ok = s->get(elem, points[n], norm, tolerance) == RESULT_CODE::SUCCESS;
+        delete elem;
+    }
+    test("Hashed set lookups after erased cells", isTrue, ok);
+
+    delete s;
+    for (auto point: points) { delete point; }
+}
+
+// swap erases on a lattice, where knn has ties, match a vector that moves its last element into the erased one;
+// eraseIf keeps the order of the rest. kind: 0 default, 1 hashed, 2 concurrent
+static void testSwapErase(ILogger* pLogger, int kind) {
+    // coordinates and distances of a power of two lattice are exact, so ties are
+    const size_t side = 32, k = 6;
+    const double tolerance = 1e-3;
+    const IVector::NORM norm = IVector::NORM::NORM_2;
+    ISet* s = kind == 0 ? ISet::createSet(pLogger) : kind == 1 ? ISet::createSet(pLogger, norm, tolerance)
+                                                               : ISet::createConcurrentSet(pLogger, norm, tolerance);
+    if (s == nullptr) { return; }
+
+    vector<array<double, DIMENSION>> model;
+    for (size_t n = 0; n < side * side; ++n) {
+        array<double, DIMENSION> point = {{static_cast<double>(n % side) / side, static_cast<double>(n / side) / side}};
+        IVector* vec = IVector::createVector(DIMENSION, point.data(), pLogger);
+        s->insert(vec, norm, tolerance);
+        model.push_back(point);
+        delete vec;
+    }
+    ISet* before = s->clone();
+
+    unsigned long long state = 5;
+    bool ok = s->swapErase(s->getSize()) == RESULT_CODE::OUT_OF_BOUNDS;
+    for (size_t n = 0; n < side * side / 2 && ok; ++n) {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        size_t index = static_cast<size_t>(state >> 33) % model.size();
+        if (n % 2 == 0) {
+            ok = s->swapErase(index) == RESULT_CODE::SUCCESS;
+        } else {
+            IVector* vec = IVector::createVector(DIMENSION, model[index].data(), pLogger);
+            ok = s->swapErase(vec, norm, tolerance) == RESULT_CODE::SUCCESS && s->swapErase(vec, norm, tolerance) == RESULT_CODE::NOT_FOUND;
+            delete vec;
+        }
+        model[index] = model.back();
+        model.pop_back();
+    }
+
+    // equally close elements come by index
+    auto nearestMatch = [&](ISet const* set, double const* at, size_t count) {
+        IVector* vec = IVector::createVector(DIMENSION, const_cast<double*>(at), pLogger);
+        size_t near[k], found = 0;
+        bool same = set->knn(vec, norm, count, near, found) == RESULT_CODE::SUCCESS && found == count;
+        delete vec;
+
+        vector<pair<double, size_t>> expected;
+        for (size_t m = 0; m < model.size(); ++m) {
+            double dx = model[m][0] - at[0], dy = model[m][1] - at[1];
+            expected.push_back(make_pair(sqrt(dx * dx + dy * dy), m));
+        }
+        sort(expected.begin(), expected.end());
+        for (size_t j = 0; j < found && same; ++j) { same = near[j] == expected[j].second; }
+        return same;
+    };
+
+    // a clone keeps the order of the set it was taken from
+    ISet* after = s->clone();
+    ok = ok && after != nullptr && s->getSize() == model.size();
+    for (size_t n = 0; n < model.size() && ok; ++n) {
+        IVector* elem = nullptr;
+        // between four points of the lattice
+        double centre[DIMENSION] = {model[n][0] + 0.5 / side, model[n][1] + 0.5 / side};
+        ok = s->get(elem, n) == RESULT_CODE::SUCCESS && elem->getCoord(0) == model[n][0] && elem->getCoord(1) == model[n][1]
+             && nearestMatch(s, model[n].data(), k) && nearestMatch(s, centre, 1) && nearestMatch(after, centre, 1);
+        delete elem;
+    }
+    delete after;
+    test(kind == 0 ? "Swap erase" : kind == 1 ? "Swap erase in a hashed set" : "Swap erase in a concurrent set", isTrue, ok);
+
+    IVector* first = nullptr;
+    ok = before != nullptr && before->getSize() == side * side && before->get(first, 1) == RESULT_CODE::SUCCESS
+         && first->getCoord(0) == 1.0 / side && first->getCoord(1) == 0;
+    delete first;
+    test("Swap erase leaves a clone as it was", isTrue, ok);
+
+    size_t erased = 0;
+    vector<array<double, DIMENSION>> kept;
+    for (auto const& point: model) {
+        if (point[0] >= 0.5) { kept.push_back(point); }
+    }
+    ok = s->eraseIf([](size_t, double const* coords) { return coords[0] < 0.5; }, erased) == RESULT_CODE::SUCCESS
+         && erased == model.size() - kept.size() && s->getSize() == kept.size();
+    for (size_t n = 0; n < kept.size() && ok; ++n) {
+        IVector *vec = IVector::createVector(DIMENSION, kept[n].data(), pLogger), *elem = nullptr;
+        ok = s->get(elem, n) == RESULT_CODE::SUCCESS && elem->getCoord(0) == kept[n][0] && elem->getCoord(1) == kept[n][1];
+        delete elem;
+        elem = nullptr;
+        ok = ok && s->get(elem, vec, norm, tolerance) == RESULT_CODE::SUCCESS;
+        delete elem;
+        delete vec;
+    }
+    test("Erase by predicate", isTrue, ok);
+
+    delete before;
+    delete s;
+}
+
 int main() {
     ISet
             *s1 = createSet(setData1, 5, nullptr),
@@ -369,6 +1021,24 @@ int main() {
         testDiff(s1, s2, pLogger);
         testSymDiff(s1, s2, pLogger);
         testInsert(pLogger);
+        testIndex(nullptr, false);
+        testIndex(nullptr, true);
+        testBulk(nullptr, false);
+        testBulk(nullptr, true);
+        testForEach(s2);
+        testNeighbours(nullptr, false);
+        testNeighbours(nullptr, true);
+        testBox(nullptr, false);
+        testBox(nullptr, true);
+        testConcurrent(nullptr);
+        testSave(nullptr);
+        testCloneChanges(nullptr, false);
+        testCloneChanges(nullptr, true);
+        testMisses(nullptr);
+        testSwapErase(nullptr, 0);
+        testSwapErase(nullptr, 1);
+        testSwapErase(nullptr, 2);
+        test("Hashed set with zero tolerance", isBad<ISet>, ISet::createSet(nullptr, IVector::NORM::NORM_2, 0));
 
         if (testClone(s1)) {
             testErase(s1, pLogger);
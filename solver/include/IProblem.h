@@ -23,6 +23,11 @@ public:
     virtual RESULT_CODE setParams(IVector const* params) = 0;
     virtual bool isCompactValid(ICompact const * const & compact) const = 0;
 
+    // guaranteed bounds of goalFunctionByArgs over the compact, NOT_FOUND if the problem cannot bound its goal
+    virtual RESULT_CODE goalFunctionBounds(ICompact const* /*compact*/, double& /*lo*/, double& /*hi*/) const {
+        return RESULT_CODE::NOT_FOUND;
+    }
+
 protected:
     virtual ~IProblem() {}
 
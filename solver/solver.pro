@@ -17,6 +17,7 @@ HEADERS += \
     include/ILogger.h \
     include/IVector.h \
     include/ICompact.h \
+    include/CompactRange.h \
     include/IProblem.h \
     include/IBrocker.h \
     include/ISolver.h
@@ -1,9 +1,20 @@
 #include <new>
 #include <cmath>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
 #include <QStringList>
 
+#if defined(_WIN32)
+#  define NOMINMAX
+#  define WIN32_LEAN_AND_MEAN
+#  include <windows.h>
+#endif
+
 #include "include/ISolver.h"
 #include "include/IBrocker.h"
+#include "include/CompactRange.h"
 
 namespace {
     class SolverImpl : public ISolver {
@@ -14,14 +25,152 @@ namespace {
         ILogger *logger;
         IProblem *problem;
         ICompact *compact;
+        std::string checkpointPath;
+        size_t checkpointPeriod;
 
         SolverImpl(const SolverImpl& other) = delete;
         void operator=(const SolverImpl& other) = delete;
 
+        // checkpoint file: header, identity of the search, best solution coordinates, iterator state blob
+        struct CheckpointHeader {
+            static const unsigned int signature = 0x32504B43; // "CKP2"
+
+            unsigned int magic;
+            unsigned long long dim;
+            double bestRes;
+            unsigned long long identitySize;
+            unsigned long long stateSize;
+        };
+
+        /* what a checkpoint belongs to: the step, the compact bounds and the problem parameters one after another,
+           written to <to> unless it is null; returns their count */
+        size_t searchIdentity(double* to) const {
+            IVector *begin = compact->getBegin(), *end = compact->getEnd();
+            IVector const* parts[] = {params, begin, end, problemParams};
+            size_t count = 0;
+            for (auto part: parts) {
+                for (size_t i = 0; part != nullptr && i < part->getDim(); i++, count++) {
+                    if (to != nullptr) { to[count] = part->getCoord(i); }
+                }
+            }
+            delete begin;
+            delete end;
+            return count;
+        }
+
+        // renames <from> over <to> in one step, an existing <to> included
+        static bool replaceFile(std::string const& from, std::string const& to) {
+#if defined(_WIN32)
+            return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+            return std::rename(from.c_str(), to.c_str()) == 0;
+#endif
+        }
+
+        // written next to the checkpoint and renamed over it, so a crash never leaves a torn file
+        RESULT_CODE saveCheckpoint(ICompact::iterator const* it, IVector const* best, double bestRes) {
+            CheckpointHeader header = {};
+            header.magic = CheckpointHeader::signature;
+            header.dim = best->getDim();
+            header.bestRes = bestRes;
+            header.identitySize = searchIdentity(nullptr);
+            header.stateSize = it->getStateSize();
+
+            size_t coordsAt = sizeof(header) + header.identitySize * sizeof(double);
+            size_t size = coordsAt + header.dim * sizeof(double) + header.stateSize;
+            char *buffer = new (std::nothrow) char[size];
+            if (buffer == nullptr) {
+                if (logger != nullptr) {
+                    logger->log("in SolverImpl::saveCheckpoint: no memory", RESULT_CODE::OUT_OF_MEMORY);
+                }
+                return RESULT_CODE::OUT_OF_MEMORY;
+            }
+
+            memcpy(buffer, &header, sizeof(header));
+            searchIdentity(reinterpret_cast<double*>(buffer + sizeof(header)));
+            auto coords = reinterpret_cast<double*>(buffer + coordsAt);
+            for (size_t i = 0; i < header.dim; i++) {
+                coords[i] = best->getCoord(i);
+            }
+
+            auto rc = it->saveState(buffer + coordsAt + header.dim * sizeof(double), header.stateSize);
+            if (rc == RESULT_CODE::SUCCESS) {
+                std::string tmpPath = checkpointPath + ".tmp";
+                FILE *file = fopen(tmpPath.c_str(), "wb");
+
+                bool written = file != nullptr && fwrite(buffer, 1, size, file) == size;
+                if (file != nullptr) {
+                    written = fclose(file) == 0 && written;
+                }
+
+                // the old checkpoint stays until the new one replaces it
+                if (!written || !replaceFile(tmpPath, checkpointPath)) {
+                    std::remove(tmpPath.c_str());
+                    rc = RESULT_CODE::FILE_ERROR;
+                }
+            }
+            delete[] buffer;
+
+            if (rc != RESULT_CODE::SUCCESS && logger != nullptr) {
+                logger->log("in SolverImpl::saveCheckpoint: checkpoint was not written", rc);
+            }
+            return rc;
+        }
+
+        /* returns nullptr when there is nothing to resume from; a checkpoint of another search, with another step,
+           compact or problem parameters, is rejected with FILE_ERROR and the search starts over */
+        ICompact::iterator* loadCheckpoint(IVector* best, double& bestRes) {
+            if (checkpointPath.empty()) { return nullptr; }
+
+            FILE *file = fopen(checkpointPath.c_str(), "rb");
+            if (file == nullptr) { return nullptr; }
+
+            CheckpointHeader header;
+            ICompact::iterator *it = nullptr;
+            size_t identitySize = searchIdentity(nullptr);
+            double *identity = nullptr, *saved = nullptr, *coords = nullptr;
+            char *state = nullptr;
+
+            if (fread(&header, sizeof(header), 1, file) == 1
+                    && header.magic == CheckpointHeader::signature
+                    && header.dim == best->getDim()
+                    && header.identitySize == identitySize) {
+                identity = new (std::nothrow) double[identitySize];
+                saved = new (std::nothrow) double[identitySize];
+                coords = new (std::nothrow) double[header.dim];
+                state = new (std::nothrow) char[header.stateSize];
+
+                if (identity != nullptr && saved != nullptr && coords != nullptr && state != nullptr
+                        && fread(saved, sizeof(double), identitySize, file) == identitySize
+                        && searchIdentity(identity) == identitySize
+                        && memcmp(identity, saved, identitySize * sizeof(double)) == 0
+                        && fread(coords, sizeof(double), header.dim, file) == header.dim
+                        && fread(state, 1, header.stateSize, file) == header.stateSize) {
+                    it = compact->restore(state, header.stateSize);
+                }
+            }
+            fclose(file);
+
+            if (it != nullptr) {
+                bestRes = header.bestRes;
+                for (size_t i = 0; i < header.dim; i++) {
+                    best->setCoord(i, coords[i]);
+                }
+            } else if (logger != nullptr) {
+                logger->log("in SolverImpl::loadCheckpoint: checkpoint does not match the problem, starting over", RESULT_CODE::FILE_ERROR);
+            }
+
+            delete[] identity;
+            delete[] saved;
+            delete[] coords;
+            delete[] state;
+            return it;
+        }
+
     public:
         SolverImpl(): solution(nullptr), params(nullptr),
             problemParams(nullptr), problem(nullptr),
-            compact(nullptr) {
+            compact(nullptr), checkpointPeriod(0) {
             logger = ILogger::createLogger(this);
         }
 
@@ -208,10 +357,80 @@ namespace {
             return RESULT_CODE::SUCCESS;
         }
 
+        RESULT_CODE setCheckpoint(char const* path, size_t period) override {
+            if (path == nullptr) {
+                checkpointPath.clear();
+                checkpointPeriod = 0;
+                return RESULT_CODE::SUCCESS;
+            }
+
+            if (period == 0) {
+                if (logger != nullptr) {
+                    logger->log("in SolverImpl::setCheckpoint: zero period", RESULT_CODE::WRONG_ARGUMENT);
+                }
+                return RESULT_CODE::WRONG_ARGUMENT;
+            }
+
+            checkpointPath = path;
+            checkpointPeriod = period;
+            return RESULT_CODE::SUCCESS;
+        }
+
         size_t getParamsDim() const override {
             return params == nullptr ? 0 : params->getDim();
         }
 
+        RESULT_CODE estimateCost(size_t& points, double& seconds) override {
+            // evaluations timed to get the cost of one point
+            static const size_t probes = 16;
+
+            if (problem == nullptr || compact == nullptr || params == nullptr) {
+                if (logger != nullptr) {
+                    logger->log("in SolverImpl::estimateCost: problem, compact or step is not set", RESULT_CODE::BAD_REFERENCE);
+                }
+                return RESULT_CODE::BAD_REFERENCE;
+            }
+
+            auto rc = compact->gridSize(params, nullptr, points);
+            if (rc != RESULT_CODE::SUCCESS && rc != RESULT_CODE::OUT_OF_BOUNDS) {
+                return rc;
+            }
+
+            if (problemParams != nullptr) {
+                rc = problem->setParams(problemParams);
+                if (rc != RESULT_CODE::SUCCESS) { return rc; }
+            }
+
+            auto it = params->getCoord(0) > 0 ? compact->begin(params) : compact->end(params);
+            if (it == nullptr) {
+                if (logger != nullptr) {
+                    logger->log("in SolverImpl::estimateCost: not valid step", RESULT_CODE::WRONG_ARGUMENT);
+                }
+                return RESULT_CODE::WRONG_ARGUMENT;
+            }
+
+            size_t timed = 0;
+            double res;
+            auto start = std::chrono::steady_clock::now();
+            do {
+                auto point = it->getPoint();
+                rc = problem->goalFunctionByArgs(point, res);
+                delete point;
+                timed++;
+            } while (rc == RESULT_CODE::SUCCESS && timed < probes && it->doStep() == RESULT_CODE::SUCCESS);
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            delete it;
+
+            if (rc != RESULT_CODE::SUCCESS) {
+                if (logger != nullptr) {
+                    logger->log("in SolverImpl::estimateCost: something wrong with goalFunctionByArgs", rc);
+                }
+                return rc;
+            }
+
+            return compact->estimateCost(params, elapsed.count() / timed, seconds);
+        }
+
         RESULT_CODE solve() override {
             static const double tolerance = 1e-6;
 
@@ -229,19 +448,6 @@ namespace {
                 return RESULT_CODE::WRONG_DIM;
             }
 
-            ICompact::iterator* it;
-            if (params->getCoord(0) > 0) {
-                it = compact->begin(params);
-            } else {
-                it= compact->end(params);
-            }
-            if (it == nullptr) {
-                if (logger != nullptr) {
-                    logger->log("in SolverImpl::solve: not valid step", RESULT_CODE::WRONG_ARGUMENT);
-                }
-                return RESULT_CODE::WRONG_ARGUMENT;
-            }
-
             if (problemParams != nullptr) {
                 auto rc = problem->setParams(problemParams);
                 if (rc != RESULT_CODE::SUCCESS) {
@@ -256,18 +462,17 @@ namespace {
             double *data = new (std::nothrow) double[dim];
 
             if (data == nullptr) {
-                delete it;
                 if (logger != nullptr) {
                     logger->log("in SolverImpl::solve: no memory", RESULT_CODE::OUT_OF_MEMORY);
                 }
                 return RESULT_CODE::OUT_OF_MEMORY;
             }
 
+            for (size_t i = 0; i < dim; i++) { data[i] = 0; }
             IVector *bestSolution = IVector::createVector(dim, data, logger);
             delete[] data;
 
             if (bestSolution == nullptr) {
-                delete it;
                 if (logger != nullptr) {
                     logger->log("in SolverImpl::solve: something bad with vector created", RESULT_CODE::WRONG_ARGUMENT);
                 }
@@ -278,13 +483,39 @@ namespace {
             double bestRes = startBestRes;
             double curRes;
 
-            auto check = RESULT_CODE::SUCCESS;
-            do {
-                auto rc = problem->goalFunctionByArgs(it->getPoint(), curRes);
+            // resume an interrupted search if there is a checkpoint of it
+            ICompact::iterator* it = loadCheckpoint(bestSolution, bestRes);
+            if (it == nullptr) {
+                bestRes = startBestRes;
+                if (params->getCoord(0) > 0) {
+                    it = compact->begin(params);
+                } else {
+                    it= compact->end(params);
+                }
+            }
+            if (it == nullptr) {
+                delete bestSolution;
+                if (logger != nullptr) {
+                    logger->log("in SolverImpl::solve: not valid step", RESULT_CODE::WRONG_ARGUMENT);
+                }
+                return RESULT_CODE::WRONG_ARGUMENT;
+            }
+
+            size_t steps = 0;
+            CompactRange points(it);
+            for (IVector const& point: points) {
+                // the saved position is the next point to be evaluated
+                if (checkpointPeriod != 0 && steps != 0 && steps % checkpointPeriod == 0) {
+                    saveCheckpoint(points.get(), bestSolution, bestRes);
+                }
+                steps++;
+
+                auto rc = problem->goalFunctionByArgs(&point, curRes);
 
                 if (rc != RESULT_CODE::SUCCESS) {
+                    delete bestSolution;
+
                     if (logger != nullptr) {
-                        delete bestSolution;
                         logger->log("in SolverImpl::solve: something wrong with goalFunctionByArgs", RESULT_CODE::WRONG_ARGUMENT);
                     }
                     return RESULT_CODE::WRONG_ARGUMENT;
@@ -292,21 +523,9 @@ namespace {
 
                 if (curRes < bestRes) {
                     bestRes = curRes;
-                    auto point = it->getPoint();
-                    if (point == nullptr) {
-                        delete it;
-                        delete bestSolution;
-
-                        if (logger != nullptr) {
-                            logger->log("in SolverImpl::solve: something wrong with goalFunctionByArgs", RESULT_CODE::WRONG_ARGUMENT);
-                        }
-                        return RESULT_CODE::WRONG_ARGUMENT;
-                    }
 
                     for (size_t i = 0; i < dim; i++) {
-                        if (bestSolution->setCoord(i, point->getCoord(i)) != RESULT_CODE::SUCCESS) {
-                            delete point;
-                            delete it;
+                        if (bestSolution->setCoord(i, point.getCoord(i)) != RESULT_CODE::SUCCESS) {
                             delete bestSolution;
 
                             if (logger != nullptr) {
@@ -315,13 +534,20 @@ namespace {
                             return RESULT_CODE::WRONG_ARGUMENT;
                         }
                     }
-                    delete point;
                 }
-                check = it->doStep();
-            } while (check == RESULT_CODE::SUCCESS);
-            delete it;
+            }
+
+            // a walk cut short by doStep keeps its checkpoint to be resumed
+            if (points.status() != RESULT_CODE::OUT_OF_BOUNDS) {
+                if (logger != nullptr) {
+                    logger->log("in SolverImpl::solve: the walk over the compact stopped early", points.status());
+                }
+            } else if (!checkpointPath.empty()) {
+                std::remove(checkpointPath.c_str());
+            }
 
             if (std::abs(startBestRes - bestRes) < tolerance) {
+                delete bestSolution;
                 if (logger != nullptr) {
                     logger->log("in SolverImpl::solve: solution not found", RESULT_CODE::NOT_FOUND);
                 }